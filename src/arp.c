@@ -1,9 +1,73 @@
 #include "types.h"
 #include "defs.h"
+#include "spinlock.h"
 #include "arp_frame.h"
 #include "nic.h"
+#include "ethernet.h"
 #include "e1000.h"
 
+#define NARP 16  // ARP cache entries
+
+// IP to MAC address translations learned from ARP replies.
+// Entries are replaced round-robin once the cache is full.
+struct {
+  struct spinlock lock;
+  struct {
+    uint32_t ip;
+    uint8_t mac[6];
+    int valid;
+  } entry[NARP];
+  int next;
+} arpcache;
+
+static void
+arp_input(struct nic_device *nd, uint8_t *frame, uint16_t length)
+{
+  uint32_t ip;
+  uint8_t mac[6];
+  int i;
+
+  if(parse_arp_reply(frame, length, &ip, mac) < 0)
+    return;
+
+  acquire(&arpcache.lock);
+  for(i = 0; i < NARP; i++)
+    if(arpcache.entry[i].valid && arpcache.entry[i].ip == ip)
+      break;
+  if(i == NARP){
+    i = arpcache.next;
+    arpcache.next = (arpcache.next + 1) % NARP;
+  }
+  arpcache.entry[i].ip = ip;
+  memmove(arpcache.entry[i].mac, mac, 6);
+  arpcache.entry[i].valid = 1;
+  release(&arpcache.lock);
+}
+
+// Look ip up in the ARP cache. Returns 0 and fills in mac on a hit.
+int
+arp_lookup(uint32_t ip, uint8_t *mac)
+{
+  int i;
+
+  acquire(&arpcache.lock);
+  for(i = 0; i < NARP; i++){
+    if(arpcache.entry[i].valid && arpcache.entry[i].ip == ip){
+      memmove(mac, arpcache.entry[i].mac, 6);
+      release(&arpcache.lock);
+      return 0;
+    }
+  }
+  release(&arpcache.lock);
+  return -1;
+}
+
+void
+arpinit(void)
+{
+  initlock(&arpcache.lock, "arpcache");
+  eth_register(ETH_TYPE_ARP, arp_input);
+}
 
 int send_arpRequest(char* interface, char* ipAddr, char* arpResp) {
   cprintf("Create arp request for ip:%s over Interface:%s\n", ipAddr, interface);
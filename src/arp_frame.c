@@ -179,46 +179,29 @@ void parse_ip (uint ip, char* ip_str) {
 
 }
 
-// ethernet packet arrived; parse and get the MAC address
-void parse_arp_reply(struct ethr_hdr eth) {
-	if (eth.ethr_type != 0x0806) {
-		cprintf("Not an ARP packet");
-		return;
-	}
-
-	if (eth.protype != 0x0800) {
-		cprintf("Not IPV4 protocol\n");
-		return;
-	}
-
-	if (eth.opcode != 2) {
-		cprintf("Not an ARP reply\n");
-		return;
-	}
+// ethernet packet arrived; if it is an ARP reply addressed to us,
+// return the sender's IP (in the same byte order get_ip produces)
+// and MAC address. Returns 0 on success, -1 otherwise.
+int parse_arp_reply(uint8_t *frame, uint16_t length, uint32_t *ip, uint8_t *mac) {
+	struct ethr_hdr *eth = (struct ethr_hdr*)frame;
 
-	char* my_mac = (char*)"FF:FF:FF:FF:FF:FF";
-	char dst_mac[18];
+	if (length < sizeof(*eth) - 2)
+		return -1;
 
-	unpack_mac(eth.arp_dmac, dst_mac);
+	if (ntohs(eth->ethr_type) != 0x0806)
+		return -1;
 
-	if (util_strcmp((const char*)my_mac, (const char*)dst_mac)) {
-		cprintf("Not the intended recipient\n");
-		return;
-	}
-
-	//parse sip; it should be equal to the one we sent
-	char* my_ip = (char*)"255.255.255.255";
-	char dst_ip[16];
+	if (ntohs(eth->hwtype) != 1 || ntohs(eth->protype) != 0x0800)
+		return -1;
 
-	parse_ip(eth.dip, dst_ip);
+	if (ntohs(eth->opcode) != 2)
+		return -1;
 
-	if (util_strcmp((const char*)my_ip, (const char*)dst_ip)) {
-	    cprintf("Not the intended recipient\n");
-	    return;
-	}
+	//the reply must be for the address we asked from
+	if (*(uint32_t*)(&eth->dip) != get_ip("10.0.2.15", strlen("10.0.2.15")))
+		return -1;
 
-	char mac[18];
-	unpack_mac(eth.arp_smac, mac);
-
-	cprintf((char*)mac);
+	*ip = eth->sip;
+	memmove(mac, eth->arp_smac, 6);
+	return 0;
 }
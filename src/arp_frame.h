@@ -19,6 +19,12 @@ struct ethr_hdr {
 };
 
 int create_eth_arp_frame(uint8_t* smac, char* ipAddr, struct ethr_hdr *eth);
+int parse_arp_reply(uint8_t *frame, uint16_t length, uint32_t *ip, uint8_t *mac);
+uint32_t get_ip(char* ip, uint len);
+uint16_t htons(uint16_t v);
+uint32_t htonl(uint32_t v);
+#define ntohs htons
+#define ntohl htonl
 void unpack_mac(uchar* mac, char* mac_str);
 char int_to_hex (uint n);
 
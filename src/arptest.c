@@ -6,8 +6,12 @@ int main(int argc,char** argv) {
 //  char* ip = "104.236.20.60";
   char* ip = "10.0.2.2";
   char* mac = malloc(MAC_SIZE);
-  if(arp("mynet0", argv[1], mac, MAC_SIZE) < 0) {
+  if(argc > 1)
+    ip = argv[1];
+  if(arp("mynet0", ip, mac, MAC_SIZE) < 0) {
     printf(1, "ARP for IP:%s Failed.\n", ip);
+  } else {
+    printf(1, "%s is at %s\n", ip, mac);
   }
   exit();
 }
@@ -0,0 +1,140 @@
+// Timekeeping: the TSC is calibrated against the PIT once at boot
+// and then provides busy-wait delays and a monotonic nanosecond
+// clock without touching any I/O port. Should calibration fail, the
+// local APIC timers tick periodically instead and nsecs() counts CPU
+// 0's ticks.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+
+#define PIT_HZ          1193182   // PIT input clock
+#define PIT_CH2         0x42      // channel 2 data port
+#define PIT_MODE        0x43      // mode/command port
+#define PIT_GATE        0x61      // channel 2 gate (bit 0) and output (bit 5)
+#define CALIBRATE_MS    10        // length of the calibration window
+
+// Scaled multiplier turning TSC cycles into ns: ns = cycles*mult >> SHIFT.
+#define SHIFT           20
+
+static uint tsc_khz;      // 0 until clockinit has run
+static uint mult;
+static uint64_t tsc_boot;
+static volatile uint ticks;  // CPU 0's timer ticks, if tsc_khz is 0
+
+// 64-by-32 bit division; the kernel is not linked with libgcc.
+uint64_t
+div64(uint64_t n, uint d)
+{
+  uint hi = n >> 32, lo = n, qhi, qlo, rem;
+
+  qhi = hi / d;
+  rem = hi % d;
+  asm volatile("divl %4" : "=a" (qlo), "=d" (rem) : "0" (lo), "1" (rem), "rm" (d));
+  return ((uint64_t)qhi << 32) | qlo;
+}
+
+// Count TSC cycles while PIT channel 2 counts down CALIBRATE_MS.
+static uint64_t
+pitcycles(void)
+{
+  uint latch = PIT_HZ / (1000 / CALIBRATE_MS);
+  uint64_t t0, t1;
+  int n;
+
+  outb(PIT_GATE, (inb(PIT_GATE) & ~0x02) | 0x01);  // gate on, speaker off
+  outb(PIT_MODE, 0xB0);   // channel 2, lobyte/hibyte, mode 0 (one-shot)
+  outb(PIT_CH2, latch & 0xFF);
+  outb(PIT_CH2, latch >> 8);
+  t0 = rdtsc();
+  for(n = 0; (inb(PIT_GATE) & 0x20) == 0; n++)
+    if(n > 10000000)
+      return 0;   // no PIT?
+  t1 = rdtsc();
+  return t1 - t0;
+}
+
+void
+clockinit(void)
+{
+  uint64_t c, best = 0;
+  int i;
+
+  // Take the shortest of a few runs: an emulator may lose the
+  // CPU in the middle of one and stretch it.
+  for(i = 0; i < 3; i++){
+    c = pitcycles();
+    if(c && (best == 0 || c < best))
+      best = c;
+  }
+  if(best == 0 || (best >> 32) != 0){
+    cprintf("clock: TSC calibration failed\n");
+    return;
+  }
+  tsc_khz = (uint)best / CALIBRATE_MS;
+  mult = div64(1000000ULL << SHIFT, tsc_khz);
+  tsc_boot = rdtsc();
+  cprintf("clock: TSC at %d.%d MHz\n", tsc_khz / 1000, (tsc_khz % 1000) / 100);
+}
+
+// Nanoseconds since clockinit.
+uint64_t
+nsecs(void)
+{
+  uint64_t c;
+
+  if(tsc_khz == 0)
+    return (uint64_t)ticks * TICKNS;
+  c = rdtsc() - tsc_boot;
+  return (((uint64_t)(uint)(c >> 32) * mult) << (32 - SHIFT)) +
+         (((uint64_t)(uint)c * mult) >> SHIFT);
+}
+
+// Whether nsecs() only advances by clocktick().
+int
+clockticks(void)
+{
+  return tsc_khz == 0;
+}
+
+// A TICKNS timer tick went by on CPU 0.
+void
+clocktick(void)
+{
+  ticks++;
+}
+
+static void
+cycledelay(uint64_t cycles)
+{
+  uint64_t end = rdtsc() + cycles;
+
+  while(rdtsc() < end)
+    ;
+}
+
+void
+ndelay(uint ns)
+{
+  if(tsc_khz == 0){
+    udelay((ns + 999) / 1000);
+    return;
+  }
+  cycledelay(div64((uint64_t)ns * tsc_khz, 1000000));
+}
+
+void
+udelay(uint us)
+{
+  uint i;
+
+  if(tsc_khz == 0){
+    // Not calibrated yet: each inb of the POST port costs
+    // roughly 1us on ISA-era timing.
+    for(i = 0; i < us; i++)
+      inb(0x80);
+    return;
+  }
+  cycledelay(div64((uint64_t)us * tsc_khz, 1000));
+}
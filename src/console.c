@@ -10,6 +10,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "file.h"
+#include "poll.h"
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
@@ -184,6 +185,7 @@ struct {
   uint r;  // Read index
   uint w;  // Write index
   uint e;  // Edit index
+  struct waitq waitq;  // pollers; cons.lock protects it
 } input;
 
 #define C(x)  ((x)-'@')  // Control-x
@@ -221,6 +223,7 @@ consoleintr(int (*getc)(void))
         if(c == '\n' || c == C('D') || input.e == input.r+INPUT_BUF){
           input.w = input.e;
           wakeup(&input.r);
+          waitq_wake(&input.waitq);
         }
       }
       break;
@@ -285,6 +288,20 @@ consolewrite(struct inode *ip, char *buf, int n)
   return n;
 }
 
+int
+consolepoll(struct inode *ip, struct pollent *pe)
+{
+  int r = POLLOUT;
+
+  acquire(&cons.lock);
+  if(pe)
+    waitq_add(&input.waitq, pe, &cons.lock);
+  if(input.r != input.w)
+    r |= POLLIN;
+  release(&cons.lock);
+  return r;
+}
+
 void
 consoleinit(void)
 {
@@ -292,6 +309,7 @@ consoleinit(void)
 
   devsw[CONSOLE].write = consolewrite;
   devsw[CONSOLE].read = consoleread;
+  devsw[CONSOLE].poll = consolepoll;
   cons.locking = 1;
 
   ioapicenable(IRQ_KBD, 0);
@@ -2,13 +2,24 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct kmemstat;
+struct lockstat;
+struct nic_device;
 struct pipe;
+struct pollent;
+struct pollfd;
 struct proc;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
+struct slabcache;
+struct slabstat;
+struct sock;
 struct stat;
 struct superblock;
+struct timer;
+struct vma;
+struct waitq;
 
 // bio.c
 void            binit(void);
@@ -16,6 +27,15 @@ struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
 
+// clock.c
+void            clockinit(void);
+void            clocktick(void);
+int             clockticks(void);
+uint64_t        div64(uint64_t, uint);
+uint64_t        nsecs(void);
+void            ndelay(uint);
+void            udelay(uint);
+
 // console.c
 void            consoleinit(void);
 void            cprintf(char*, ...);
@@ -33,6 +53,7 @@ void            fileinit(void);
 int             fileread(struct file*, char*, int n);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
+int             filepoll(struct file*, struct pollent*);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
@@ -68,6 +89,14 @@ char*           kalloc(void);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+void            kmemstat(struct kmemstat*);
+char*           kzalloc(void);
+int             kfreecount(void);
+void            kref(char*);
+int             krefcount(char*);
+char*           kallocpages(int);
+void            kfreepages(char*, int);
+int             kzeroidle(void);
 
 // kbd.c
 void            kbdintr(void);
@@ -78,8 +107,10 @@ int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicarm(uint64_t);
+void            lapiccalibrate(void);
+void            lapicipi(int, int);
 void            lapicstartap(uchar, uint);
-void            microdelay(int);
 
 // log.c
 void            initlog(int dev);
@@ -95,11 +126,31 @@ void            mpinit(void);
 void            picenable(int);
 void            picinit(void);
 
+// nic.c
+void            netmapfree(struct proc*);
+
+// mmap.c
+int             mmap(struct file*, uint, int, int, uint);
+int             munmap(uint, uint);
+uint            vmabase(struct proc*);
+int             vmacopy(struct proc*, struct proc*);
+int             vmafault(struct proc*, struct vma*, uint, uint);
+void            vmafree(struct proc*);
+struct vma*     vmalookup(struct proc*, uint);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
+void            pipeinit(void);
 int             piperead(struct pipe*, char*, int);
 int             pipewrite(struct pipe*, char*, int);
+int             pipepoll(struct pipe*, int, struct pollent*);
+
+// poll.c
+void            pollinit(void);
+int             poll(struct file**, struct pollfd*, int, int);
+void            waitq_add(struct waitq*, struct pollent*, struct spinlock*);
+void            waitq_wake(struct waitq*);
 
 //PAGEBREAK: 16
 // proc.c
@@ -109,11 +160,14 @@ int             fork(void);
 int             growproc(int);
 int             kill(int);
 struct cpu*     mycpu(void);
+int             preempted(void);
 struct proc*    myproc();
 void            pinit(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
+int             setaffinity(uint);
+int             setpriority(int, int, int);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
@@ -124,11 +178,29 @@ void            yield(void);
 // swtch.S
 void            swtch(struct context**, struct context*);
 
+// slab.c
+void*           slaballoc(struct slabcache*);
+struct slabcache* slabcreate(char*, uint);
+void            slabfree(struct slabcache*, void*);
+void            slabinit(void);
+int             slabstat(struct slabstat*, int);
+
+// socket.c
+void            sockinit(void);
+struct sock*    sockalloc(struct nic_device*, uint16_t);
+void            sockclose(struct sock*);
+int             sock_input(struct nic_device*, uint8_t*, uint16_t);
+int             sockpoll(struct sock*, struct pollent*);
+int             sockread(struct sock*, char*, int);
+int             sockwrite(struct sock*, char*, int);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+int             lockbusy(struct spinlock*);
+int             lockstat(struct lockstat*, int);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
@@ -151,25 +223,36 @@ char*           strncpy(char*, const char*, int);
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
+int             argbuf(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
 void            syscall(void);
 
 // timer.c
+int             nsleep(uint64_t);
+void            timeradd(struct timer*, uint64_t, void (*)(void*), void*);
+void            timerarm(void);
+void            timerdel(struct timer*);
 void            timerinit(void);
+void            timerintr(void);
+void            timerslice(int);
 
 // trap.c
 void            idtinit(void);
-extern uint     ticks;
 void            tvinit(void);
-extern struct spinlock tickslock;
 
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
 
+// uring.c
+int             uringenter(int, int);
+void            uringfree(struct proc*);
+void            uringinit(void);
+int             uringsetup(void);
+
 // vm.c
 void            seginit(void);
 void            kvmalloc(void);
@@ -181,13 +264,25 @@ void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
+int             uvmshare(pde_t*, pde_t*, uint, uint, int);
+int             uvmaccess(struct proc*, uint, uint, int);
+pte_t*          walkpgdir(pde_t*, const void*, int);
+int             mappages(pde_t*, void*, uint, uint, int);
+int             cowfault(pde_t*, uint);
+int             lazyfault(struct proc*, uint);
+int             pagefault(struct proc*, uint, uint);
+int             uvmtouch(struct proc*, uint, uint, int);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+int             mapuvm(pde_t*, uint, uint, uint, int);
+void            unmapuvm(pde_t*, uint, uint);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
 
 // arp.c
+void arpinit(void);
+int arp_lookup(uint32_t ip, uint8_t *mac);
 int send_arpRequest(char* interface, char* ipAddr, char* arpResp);
\ No newline at end of file
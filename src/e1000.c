@@ -4,6 +4,8 @@
 #include "arp_frame.h"
 #include "nic.h"
 #include "memlayout.h"
+#include "mmu.h"
+#include "netmap.h"
 
  static void e1000_reg_write(uint32_t reg_addr, uint32_t value, struct e1000 *the_e1000) {
    *(uint32_t*)(the_e1000->membase + (reg_addr)) = value;
@@ -16,19 +18,90 @@
    return value;
  }
 
- // Each inb of port 0x84 takes about 1.25us
- // Super stupid delay logic. Don't even know if this works
- // or understand what port 0x84 does.
- // Could not find an explanantion.
-void udelay(unsigned int u)
+ // Program receive address slot idx with mac, or invalidate it if mac is 0.
+ static void e1000_set_rar(struct e1000 *the_e1000, int idx, uint8_t *mac)
  {
- 	unsigned int i;
- 	for (i = 0; i < u; i++)
- 		inb(0x84);
+   if(mac == 0) {
+     e1000_reg_write(E1000_RCV_RAH(idx), 0, the_e1000);
+     e1000_reg_write(E1000_RCV_RAL(idx), 0, the_e1000);
+     return;
+   }
+   //RAH holds the valid bit: clear it while RAL changes
+   e1000_reg_write(E1000_RCV_RAH(idx), 0, the_e1000);
+   e1000_reg_write(E1000_RCV_RAL(idx),
+                   mac[0] | (mac[1] << 8) | (mac[2] << 16) | ((uint32_t)mac[3] << 24),
+                   the_e1000);
+   e1000_reg_write(E1000_RCV_RAH(idx),
+                   mac[4] | (mac[5] << 8) | E1000_RAH_AV,
+                   the_e1000);
+ }
+
+ // Rewrite the multicast table array from the list of joined groups.
+ // With RCTL.MO=0 the hash is bits 47:36 of the destination address:
+ // bits 11:5 select one of the 128 MTA registers, bits 4:0 the bit in it.
+ static void e1000_mta_update(struct e1000 *the_e1000)
+ {
+   uint32_t mta[E1000_MTA_ENTRIES];
+   uint32_t hash;
+
+   memset(mta, 0, sizeof(mta));
+   for(int i=0; i<the_e1000->nmcast; i++) {
+     hash = ((the_e1000->mcast[i][4] >> 4) | (the_e1000->mcast[i][5] << 4)) & 0xfff;
+     mta[hash >> 5] |= 1 << (hash & 0x1f);
+   }
+   for(int i=0; i<E1000_MTA_ENTRIES; i++)
+     e1000_reg_write(E1000_MTA + 4*i, mta[i], the_e1000);
+ }
+
+ static int e1000_mcast(struct e1000 *the_e1000, uint8_t *mac, int join)
+ {
+   int i;
+
+   if(mac == 0 || (mac[0] & 1) == 0)
+     return -1;  //not a multicast address
+   for(i=0; i<the_e1000->nmcast; i++)
+     if(memcmp(the_e1000->mcast[i], mac, 6) == 0)
+       break;
+   if(join) {
+     if(i < the_e1000->nmcast)
+       return 0;
+     if(the_e1000->nmcast == E1000_NMCAST)
+       return -1;
+     memmove(the_e1000->mcast[the_e1000->nmcast++], mac, 6);
+   } else {
+     if(i == the_e1000->nmcast)
+       return -1;
+     the_e1000->nmcast--;
+     memmove(the_e1000->mcast[i], the_e1000->mcast[the_e1000->nmcast], 6);
+   }
+   e1000_mta_update(the_e1000);
+   return 0;
+ }
+
+ // Put the TX ring back into its initial, empty state after the
+ // hardware stopped completing descriptors. Only the ring is reset;
+ // the rest of the device configuration is left alone.
+ static void e1000_tx_reset(struct e1000 *the_e1000)
+ {
+   uint32_t tctl = e1000_reg_read(E1000_TCTL, the_e1000);
+
+   e1000_reg_write(E1000_TCTL, tctl & ~E1000_TCTL_EN, the_e1000);
+   for(int i=0; i<E1000_TBD_SLOTS; i++) {
+     memset(the_e1000->tbd[i], 0, sizeof(struct e1000_tbd));
+     the_e1000->tbd[i]->status = E1000_TXD_STAT_DD;
+   }
+   the_e1000->tbd_head = the_e1000->tbd_tail = the_e1000->tdt = 0;
+   e1000_reg_write(E1000_TDH, 0, the_e1000);
+   e1000_reg_write(E1000_TDT, 0, the_e1000);
+   e1000_reg_write(E1000_TCTL, tctl, the_e1000);
+   the_e1000->tx_resets++;
  }
 
  void e1000_send(void *driver, uint8_t *pkt, uint16_t length )
  {
+   struct e1000 *e1000 = (struct e1000*)driver;
+
+#ifdef E1000_DEBUG
      cprintf("e1000 send:\n");
      int k;
      for(k=0;k!=length;++k)
@@ -37,29 +110,152 @@ void udelay(unsigned int u)
          cprintf("%x%x ",((pkt[k])>>4)&(0xf),(pkt[k])&(0xf));
      }
      cprintf("\n");
-
-   struct e1000 *e1000 = (struct e1000*)driver;
    cprintf("e1000 driver: Sending packet of length:0x%x %x starting at physical address:0x%x\n", length, sizeof(struct ethr_hdr), V2P(e1000->tx_buf[e1000->tbd_tail]));
+#endif
+
+   if(length > sizeof(struct packet_buf))
+     return;
+
+   acquire(&e1000->lock);
+   if(e1000->nm) {
+     //the rings belong to the netmap() user
+     e1000->tx_drops++;
+     release(&e1000->lock);
+     return;
+   }
+   //while the link is down frames queue up in the ring without
+   //being handed to the hardware; drop them once the ring is full
+   if(!e1000->link_up &&
+      (e1000->tbd_tail + 1) % E1000_TBD_SLOTS == e1000->tdt) {
+     e1000->tx_drops++;
+     release(&e1000->lock);
+     return;
+   }
+
    memset(e1000->tbd[e1000->tbd_tail], 0, sizeof(struct e1000_tbd));
    memmove((e1000->tx_buf[e1000->tbd_tail]), pkt, length);
    e1000->tbd[e1000->tbd_tail]->addr = (uint64_t)(uint32_t)V2P(e1000->tx_buf[e1000->tbd_tail]);
  	e1000->tbd[e1000->tbd_tail]->length = length;
  	e1000->tbd[e1000->tbd_tail]->cmd = 9;//(E1000_TDESC_CMD_RS | E1000_TDESC_CMD_EOP | E1000_TDESC_CMD_IFCS);
    e1000->tbd[e1000->tbd_tail]->cso = 0;
- 	// update the tail so the hardware knows it's ready
+   if(e1000->tx_vlan) {
+     //the NIC inserts the 802.1Q tag; the frame itself stays untagged
+     e1000->tbd[e1000->tbd_tail]->cmd |= E1000_TDESC_CMD_VLE;
+     e1000->tbd[e1000->tbd_tail]->special = e1000->tx_vlan;
+   }
  	int oldtail = e1000->tbd_tail;
  	e1000->tbd_tail = (e1000->tbd_tail + 1) % E1000_TBD_SLOTS;
- 	e1000_reg_write(E1000_TDT, e1000->tbd_tail, e1000);
+   if(!e1000->link_up) {
+     //TX queue is paused; e1000_intr() hands it over on link up
+     release(&e1000->lock);
+     return;
+   }
 
+ 	// update the tail so the hardware knows it's ready
+   e1000->tdt = e1000->tbd_tail;
+ 	e1000_reg_write(E1000_TDT, e1000->tdt, e1000);
+
+   int spins = 0;
  	while( !E1000_TDESC_STATUS_DONE(e1000->tbd[oldtail]->status) )
  	{
+     if(++spins == E1000_TX_TIMEOUT) {
+       cprintf("e1000: transmit timed out, resetting TX ring\n");
+       e1000_tx_reset(e1000);
+       break;
+     }
  		udelay(2);
  	}
-   cprintf("after while loop\n");
+   release(&e1000->lock);
+ }
+
+ // Global reset: everything but the PCI configuration returns to its
+ // power-on state and the EEPROM is reloaded. Returns -1 if the reset
+ // bit does not self-clear.
+ static int e1000_reset(struct e1000 *the_e1000)
+ {
+   int i;
+
+   e1000_reg_write(E1000_IMC, 0xffffffff, the_e1000);
+   e1000_reg_write(E1000_CNTRL_REG,
+     e1000_reg_read(E1000_CNTRL_REG, the_e1000) | E1000_CNTRL_RST_MASK,
+     the_e1000);
+   //read back the value after approx 1us to check RST bit cleared
+   for(i = 0; i < E1000_RESET_TIMEOUT; i++) {
+     udelay(3);
+     if(!E1000_CNTRL_RST_BIT(e1000_reg_read(E1000_CNTRL_REG, the_e1000)))
+       break;
+   }
+   if(i == E1000_RESET_TIMEOUT)
+     return -1;
+
+   //interrupts come back unmasked after reset; mask and ack them again
+   e1000_reg_write(E1000_IMC, 0xffffffff, the_e1000);
+   e1000_reg_read(E1000_ICR, the_e1000);
+   return 0;
+ }
+
+ // Read one 16-bit word from the EEPROM through EERD.
+ static int e1000_eeprom_read(struct e1000 *the_e1000, uint8_t addr, uint16_t *data)
+ {
+   uint32_t eerd;
+
+   e1000_reg_write(E1000_EERD_REG_ADDR,
+                   E1000_EERD_ADDR(addr) | E1000_EERD_START_BIT_MASK,
+                   the_e1000);
+   for(int i = 0; i < E1000_EERD_TIMEOUT; i++) {
+     eerd = e1000_reg_read(E1000_EERD_REG_ADDR, the_e1000);
+     if(E1000_EERD_DONE(eerd)) {
+       *data = E1000_EERD_DATA(eerd);
+       return 0;
+     }
+     udelay(1);
+   }
+   return -1;
+ }
+
+ // Re-read the link state after a link status change.
+ static void e1000_link_change(struct e1000 *the_e1000)
+ {
+   int up = (e1000_reg_read(E1000_STATUS, the_e1000) & E1000_STATUS_LU) != 0;
+
+   if(up == the_e1000->link_up)
+     return;
+   the_e1000->link_up = up;
+   cprintf("e1000: link %s\n", up ? "up" : "down");
+   if(up && the_e1000->tdt != the_e1000->tbd_tail) {
+     //resume the TX queue: hand over whatever queued while down
+     the_e1000->tdt = the_e1000->tbd_tail;
+     e1000_reg_write(E1000_TDT, the_e1000->tdt, the_e1000);
+   }
+ }
+
+ static struct e1000 *e1000dev;  // the device interrupts are routed for
+
+ void e1000_intr(void)
+ {
+   struct e1000 *the_e1000 = e1000dev;
+   uint32_t icr;
+   int rx;
+
+   if(the_e1000 == 0)
+     return;
+   acquire(&the_e1000->lock);
+   //reading ICR acknowledges (clears) the pending causes
+   icr = e1000_reg_read(E1000_ICR, the_e1000);
+   if(icr & E1000_IMS_LSC)
+     e1000_link_change(the_e1000);
+   if(icr & E1000_IMS_RXO)
+     the_e1000->rx_overruns++;
+   rx = (icr & (E1000_IMS_RXT0 | E1000_IMS_RXO)) != 0;
+   release(&the_e1000->lock);
+   //frames are still pulled by e1000_recv(); just wake the readers
+   if(rx)
+     nic_rxready(the_e1000);
  }
 
  int e1000_init(struct pci_func *pcif, void** driver, uint8_t *mac_addr) {
    struct e1000 *the_e1000 = (struct e1000*)kalloc();
+   memset(the_e1000, 0, sizeof(*the_e1000));
 
  	for (int i = 0; i < 6; i++) {
      // I/O port numbers are 16 bits, so they should be between 0 and 0xffff.
@@ -89,29 +285,39 @@ void udelay(unsigned int u)
    the_e1000->tbd_head = the_e1000->tbd_tail = 0;
    the_e1000->rbd_head = the_e1000->rbd_tail = 0;
 
+   initlock(&the_e1000->lock, "e1000");
+
    // Reset device but keep the PCI config
-   // e1000_reg_write(E1000_CNTRL_REG,
-   //   e1000_reg_read(E1000_CNTRL_REG, the_e1000) | E1000_CNTRL_RST_MASK,
-   //   the_e1000);
-   // //read back the value after approx 1us to check RST bit cleared
-   // do {
-   //   udelay(3);
-   // }while(E1000_CNTRL_RST_BIT(e1000_reg_read(E1000_CNTRL_REG, the_e1000)));
-
-   // //the manual says in Section 14.3 General Config -
-   // //Must set the ASDE and SLU(bit 5 and 6(0 based index)) in the CNTRL Reg to allow auto speed
-   // //detection after RESET
-   // uint32_t cntrl_reg = e1000_reg_read(E1000_CNTRL_REG, the_e1000);
-   // e1000_reg_write(E1000_CNTRL_REG, cntrl_reg | E1000_CNTRL_ASDE_MASK | E1000_CNTRL_SLU_MASK,
-   //   the_e1000);
-
-   //Read Hardware(MAC) address from the device
-   uint32_t macaddr_l = e1000_reg_read(E1000_RCV_RAL0, the_e1000);
-   uint32_t macaddr_h = e1000_reg_read(E1000_RCV_RAH0, the_e1000);
-   *(uint32_t*)the_e1000->mac_addr = macaddr_l;
-   *(uint16_t*)(&the_e1000->mac_addr[4]) = (uint16_t)macaddr_h;
-   *(uint32_t*)mac_addr = macaddr_l;
-   *(uint32_t*)(&mac_addr[4]) = (uint16_t)macaddr_h;
+   if(e1000_reset(the_e1000) < 0) {
+     cprintf("ERROR:e1000:device did not come out of reset\n");
+     kfree((char*)the_e1000);
+     return -1;
+   }
+
+   //the manual says in Section 14.3 General Config -
+   //Must set the ASDE and SLU(bit 5 and 6(0 based index)) in the CNTRL Reg to allow auto speed
+   //detection after RESET
+   uint32_t cntrl_reg = e1000_reg_read(E1000_CNTRL_REG, the_e1000);
+   e1000_reg_write(E1000_CNTRL_REG, cntrl_reg | E1000_CNTRL_ASDE_MASK | E1000_CNTRL_SLU_MASK,
+     the_e1000);
+
+   //Read Hardware(MAC) address from the EEPROM (words 0-2). If EERD
+   //does not answer fall back to what the reset loaded into RAL0/RAH0.
+   uint16_t word;
+   int w;
+   for(w = 0; w < 3; w++) {
+     if(e1000_eeprom_read(the_e1000, w, &word) < 0)
+       break;
+     the_e1000->mac_addr[2*w] = word & 0xff;
+     the_e1000->mac_addr[2*w+1] = word >> 8;
+   }
+   if(w < 3) {
+     uint32_t macaddr_l = e1000_reg_read(E1000_RCV_RAL0, the_e1000);
+     uint32_t macaddr_h = e1000_reg_read(E1000_RCV_RAH0, the_e1000);
+     *(uint32_t*)the_e1000->mac_addr = macaddr_l;
+     *(uint16_t*)(&the_e1000->mac_addr[4]) = (uint16_t)macaddr_h;
+   }
+   memmove(mac_addr, the_e1000->mac_addr, 6);
    char mac_str[18];
    unpack_mac(the_e1000->mac_addr, mac_str);
    mac_str[17] = 0;
@@ -158,11 +364,22 @@ void udelay(unsigned int u)
      return -1;
    }
 
-   //Now for the packet buffers in Receive Ring. Can fit 2 packet buf in 1 page
+   //Packet buffers come from one contiguous DMA area per ring:
+   //2 TX buffers per page, one RX buffer per page (see e1000.h)
    struct packet_buf *tmp;
+   char *txmem = kallocpages(E1000_TXBUF_ORDER);
+   char *rxmem = kallocpages(E1000_RXBUF_ORDER);
+   if(txmem == 0 || rxmem == 0) {
+     cprintf("ERROR:e1000:no memory for packet buffers\n");
+     if(txmem)
+       kfreepages(txmem, E1000_TXBUF_ORDER);
+     if(rxmem)
+       kfreepages(rxmem, E1000_RXBUF_ORDER);
+     return -1;
+   }
 
    for(int i=0; i<E1000_TBD_SLOTS; i+=2) {
-     tmp = (struct packet_buf*)kalloc();
+     tmp = (struct packet_buf*)(txmem + (i/2)*PGSIZE);
      the_e1000->tx_buf[i] = tmp;
      tmp++;
      //the_e1000->tbd[i]->addr = (uint32_t)the_e1000->tx_buf[i];
@@ -194,16 +411,25 @@ void udelay(unsigned int u)
    the_e1000->rbd_tail=E1000_RBD_SLOTS-1;
    the_e1000->rbd_head=0;
                   
-   e1000_reg_write(E1000_RCV_RAL0, 0x12005452, the_e1000);
-   e1000_reg_write(E1000_RCV_RAH0, 0x5634|0x80000000, the_e1000);
-   //e1000_reg_write(E1000_MTA,0,the_e1000);
+   //Accept our own address in slot 0 and nothing else until asked to:
+   //frames for other addresses are then dropped by the NIC, not the CPU.
+   e1000_set_rar(the_e1000, 0, the_e1000->mac_addr);
+   for(int i=1; i<E1000_RCV_RAR_SLOTS; i++)
+     e1000_set_rar(the_e1000, i, 0);
+   e1000_mta_update(the_e1000);
+
+   //VLAN filtering stays off until enabled with NIC_CTL_VLAN,
+   //but start from an empty filter table
+   e1000_reg_write(E1000_VET, E1000_VLAN_ETHERTYPE, the_e1000);
+   for(int i=0; i<E1000_VFTA_ENTRIES; i++)
+     e1000_reg_write(E1000_VFTA + 4*i, 0, the_e1000);
    e1000_reg_write(E1000_RDBAL, V2P(*(the_e1000->rbd)), the_e1000);
    e1000_reg_write(E1000_RDBAH, 0x00000000, the_e1000);
    e1000_reg_write(E1000_RDLEN, (E1000_RBD_SLOTS*16), the_e1000);
    cprintf("RX Ring Size: %d\n",(E1000_RBD_SLOTS*16));
 
    for(int i=0; i<E1000_RBD_SLOTS; i+=1) {
-     tmp = (struct packet_buf*)kalloc();
+     tmp = (struct packet_buf*)(rxmem + i*PGSIZE);
      the_e1000->rx_buf[i] = tmp;
      //tmp++;
      // the_e1000->rbd[i]->addr_l = V2P((uint32_t)the_e1000->rx_buf[i])+4;
@@ -225,13 +451,6 @@ void udelay(unsigned int u)
    //e1000_reg_write(E1000_MANC,E1000_MANC_ARP_EN|E1000_MANC_ARP_RES_EN,the_e1000);
 
 
-   //enable interrupts
-   // e1000_reg_write(E1000_IMS, E1000_IMS_RXSEQ |
-   //                            E1000_IMS_RXO |
-   //                            E1000_IMS_RXT0|
-   //                            E1000_IMS_TXQE|
-   //                            E1000_IMS_LSC|
-   //                            E1000_IMS_RXDMT0, the_e1000);
    //Receive control Register.
    uint32_t rflag=0;
    rflag|=E1000_RCTL_EN;
@@ -251,9 +470,14 @@ void udelay(unsigned int u)
  //                the_e1000);
  //cprintf("e1000:Interrupt enabled mask:0x%x\n", e1000_reg_read(E1000_IMS, the_e1000));
    //Register interrupt handler here...
+   e1000dev = the_e1000;
    picenable(the_e1000->irq_line);
    ioapicenable(the_e1000->irq_line, 0);
-   ioapicenable(the_e1000->irq_line, 1);
+
+   //link changes and received frames interrupt; frames themselves are
+   //pulled by e1000_recv() in whoever was woken
+   the_e1000->link_up = (e1000_reg_read(E1000_STATUS, the_e1000) & E1000_STATUS_LU) != 0;
+   e1000_reg_write(E1000_IMS, E1000_IMS_LSC | E1000_IMS_RXO | E1000_IMS_RXT0, the_e1000);
 
 
    *driver = the_e1000;
@@ -262,18 +486,277 @@ void udelay(unsigned int u)
 
  void e1000_recv(void *driver, uint8_t* pkt, uint16_t *length) {
    struct e1000 *the_e1000=(struct e1000*)driver;
-   int i=(the_e1000->rbd_tail+1)%E1000_RBD_SLOTS;
-   if(!(the_e1000->rbd[i]->status&E1000_RXD_STAT_DD )||!(the_e1000->rbd[i]->status&E1000_RXD_STAT_EOP))
-   {
-     *length=0;
+   int i;
+
+   *length=0;
+   acquire(&the_e1000->lock);
+   while(!the_e1000->nm) {
+     i=(the_e1000->rbd_tail+1)%E1000_RBD_SLOTS;
+     if(!(the_e1000->rbd[i]->status&E1000_RXD_STAT_DD))
+       break;
+     //frames spanning several descriptors or received with errors are
+     //recycled; leaving them in place would stall the ring for good
+     if(!(the_e1000->rbd[i]->status&E1000_RXD_STAT_EOP) ||
+        the_e1000->rbd[i]->errors ||
+        the_e1000->rbd[i]->length > sizeof(struct packet_buf)) {
+#ifdef E1000_DEBUG
+       cprintf("ERRORS: %x\n",the_e1000->rbd[i]->errors);
+#endif
+       the_e1000->rx_errors++;
+     } else {
+       *length=the_e1000->rbd[i]->length;
+       memmove(pkt,P2V((uint8_t*)(uint32_t)(the_e1000->rbd[i]->addr)),(uint)(*length));
+     }
+     the_e1000->rbd[i]->status=0;
+     the_e1000->rbd[i]->errors=0;
+     the_e1000->rbd_tail=i;
+     //give the descriptor back to the hardware
+     e1000_reg_write(E1000_RDT, i, the_e1000);
+     if(*length)
+       break;
+   }
+   release(&the_e1000->lock);
+ }
+
+ // 802.1Q VLAN offload. With CTRL.VME set the NIC strips the tag of
+ // every received frame into the descriptor's special field, where the
+ // driver ignores it, and with RCTL.VFE drops frames whose VLAN id is
+ // not set in the VFTA. It also only inserts tags into sent frames
+ // while VME is set, so turning VLAN mode off stops tagging too.
+ static void e1000_vlan_mode(struct e1000 *the_e1000, int on) {
+   uint32_t ctrl = e1000_reg_read(E1000_CNTRL_REG, the_e1000);
+   uint32_t rctl = e1000_reg_read(E1000_RCTL, the_e1000);
+
+   if(on) {
+     ctrl |= E1000_CNTRL_VME_MASK;
+     rctl |= E1000_RCTL_VFE;
+   } else {
+     ctrl &= ~E1000_CNTRL_VME_MASK;
+     rctl &= ~E1000_RCTL_VFE;
+     the_e1000->tx_vlan = 0;
+   }
+   e1000_reg_write(E1000_CNTRL_REG, ctrl, the_e1000);
+   e1000_reg_write(E1000_RCTL, rctl, the_e1000);
+ }
+
+ static void e1000_vlan_filter(struct e1000 *the_e1000, uint16_t vid, int accept) {
+   int idx = (vid >> 5) & (E1000_VFTA_ENTRIES - 1);
+
+   if(accept)
+     the_e1000->vfta[idx] |= 1 << (vid & 0x1f);
+   else
+     the_e1000->vfta[idx] &= ~(1 << (vid & 0x1f));
+   e1000_reg_write(E1000_VFTA + 4*idx, the_e1000->vfta[idx], the_e1000);
+ }
+
+ static int e1000_ctlop(struct e1000 *the_e1000, int op, int arg, uint8_t *addr) {
+   switch(op) {
+   case NIC_CTL_VLAN:
+     e1000_vlan_mode(the_e1000, arg);
+     return 0;
+   case NIC_CTL_VLAN_ADD:
+   case NIC_CTL_VLAN_DEL:
+     if(arg <= 0 || arg >= E1000_VLAN_VID_MASK)
+       return -1;
+     e1000_vlan_filter(the_e1000, arg, op == NIC_CTL_VLAN_ADD);
+     return 0;
+   case NIC_CTL_VLAN_TAG:
+     if(arg < 0 || arg > 0xffff)
+       return -1;
+     if(arg && !(e1000_reg_read(E1000_CNTRL_REG, the_e1000) & E1000_CNTRL_VME_MASK))
+       return -1;
+     the_e1000->tx_vlan = arg;
+     return 0;
+   case NIC_CTL_PROMISC: {
+     uint32_t rctl = e1000_reg_read(E1000_RCTL, the_e1000);
+     if(arg)
+       rctl |= E1000_RCTL_UPE | E1000_RCTL_MPE;
+     else
+       rctl &= ~(E1000_RCTL_UPE | E1000_RCTL_MPE);
+     e1000_reg_write(E1000_RCTL, rctl, the_e1000);
+     return 0;
+   }
+   case NIC_CTL_RAR_SET:
+     //slot 0 is the station address; replacing it changes who we are
+     if(arg < 0 || arg >= E1000_RCV_RAR_SLOTS || (arg == 0 && addr == 0))
+       return -1;
+     e1000_set_rar(the_e1000, arg, addr);
+     if(arg == 0)
+       memmove(the_e1000->mac_addr, addr, 6);
+     return 0;
+   case NIC_CTL_MCAST_ADD:
+   case NIC_CTL_MCAST_DEL:
+     return e1000_mcast(the_e1000, addr, op == NIC_CTL_MCAST_ADD);
+   }
+   return -1;
+ }
+
+ //the operations read-modify-write CTRL, RCTL and the shadows of the
+ //filter tables, and e1000_send reads tx_vlan: all under the lock
+ int e1000_ctl(void *driver, int op, int arg, uint8_t *addr) {
+   struct e1000 *the_e1000 = (struct e1000*)driver;
+   int r;
+
+   acquire(&the_e1000->lock);
+   r = e1000_ctlop(the_e1000, op, arg, addr);
+   release(&the_e1000->lock);
+   return r;
+ }
+
+ // netmap(): the user's mapping is one page of shadow rings, the TX
+ // buffer pages (two buffers each), then one page per RX buffer.
+ #define E1000_NM_TXPAGES  (E1000_TBD_SLOTS / 2)
+ #define E1000_NM_PAGES    (1 + E1000_NM_TXPAGES + E1000_RBD_SLOTS)
+
+ #define NM_NEXT(i, n)   (((i) + 1) % (n))
+ #define NM_DIST(a, b, n) (((b) - (a) + (n)) % (n))   //slots from a up to b
+
+ int e1000_nm_attach(void *driver, pde_t *pgdir, uint va) {
+   struct e1000 *the_e1000 = (struct e1000*)driver;
+   struct nm_if *nm;
+   int i;
+
+   if(NM_SLOTS != E1000_RBD_SLOTS || NM_SLOTS != E1000_TBD_SLOTS)
+     return -1;
+   if((nm = (struct nm_if*)kzalloc()) == 0)
+     return -1;
+
+   acquire(&the_e1000->lock);
+   if(the_e1000->nm)
+     goto bad;
+   if(mapuvm(pgdir, va, V2P(nm), PGSIZE, PTE_W) < 0)
+     goto bad;
+   for(i=0; i<E1000_TBD_SLOTS; i+=2)
+     if(mapuvm(pgdir, va + (1 + i/2)*PGSIZE, V2P(the_e1000->tx_buf[i]), PGSIZE, PTE_W) < 0)
+       goto bad;
+   for(i=0; i<E1000_RBD_SLOTS; i++)
+     if(mapuvm(pgdir, va + (1 + E1000_NM_TXPAGES + i)*PGSIZE, V2P(the_e1000->rx_buf[i]),
+               PGSIZE, PTE_W) < 0)
+       goto bad;
+
+   //RX: nothing for the user yet; the NIC keeps every other slot
+   nm->rx.nslots = E1000_RBD_SLOTS;
+   nm->rx.bufsize = 2048;
+   for(i=0; i<E1000_RBD_SLOTS; i++)
+     nm->rx.slot[i].off = (1 + E1000_NM_TXPAGES + i)*PGSIZE + 4;
+   the_e1000->nm_rxhead = the_e1000->nm_rxtail = NM_NEXT(the_e1000->rbd_tail, E1000_RBD_SLOTS);
+
+   //TX: e1000_send() leaves nothing in flight, so all slots but the
+   //one before head are free
+   nm->tx.nslots = E1000_TBD_SLOTS;
+   nm->tx.bufsize = sizeof(struct packet_buf);
+   for(i=0; i<E1000_TBD_SLOTS; i++)
+     nm->tx.slot[i].off = (1 + i/2)*PGSIZE + (i%2)*sizeof(struct packet_buf);
+   the_e1000->nm_txhead = the_e1000->tbd_tail;
+   the_e1000->nm_txtail = (the_e1000->tbd_tail + E1000_TBD_SLOTS - 1) % E1000_TBD_SLOTS;
+
+   nm->rx.head = the_e1000->nm_rxhead;
+   nm->rx.tail = the_e1000->nm_rxtail;
+   nm->tx.head = the_e1000->nm_txhead;
+   nm->tx.tail = the_e1000->nm_txtail;
+   the_e1000->nm = nm;
+   release(&the_e1000->lock);
+   return 0;
+
+ bad:
+   release(&the_e1000->lock);
+   unmapuvm(pgdir, va, E1000_NM_PAGES*PGSIZE);
+   kfree((char*)nm);
+   return -1;
+ }
+
+ void e1000_nm_detach(void *driver, pde_t *pgdir, uint va) {
+   struct e1000 *the_e1000 = (struct e1000*)driver;
+   struct nm_if *nm;
+   int i;
+
+   acquire(&the_e1000->lock);
+   if((nm = the_e1000->nm) == 0) {
+     release(&the_e1000->lock);
      return;
    }
-   *length=the_e1000->rbd[i]->length;
-   //pkt=&(the_e1000->rx_buf[i]->buf[0]);
-   //memmove(pkt,(uint8_t*)P2V(the_e1000->rbd[i]->addr_l),(uint)(*length));
-   memmove(pkt,P2V((uint8_t*)(uint32_t)(the_e1000->rbd[i]->addr)),(uint)(*length));
-   the_e1000->rbd[i]->status=0;
-   cprintf("ERRORS: %x\n",the_e1000->rbd[i]->errors);
-   cprintf("CHECKSUM: %x\n",the_e1000->rbd[i]->checksum);
-   the_e1000->rbd_tail=i;
- }
\ No newline at end of file
+   //frames still held by the user are dropped; give their slots back
+   for(i=the_e1000->nm_rxhead; i!=the_e1000->nm_rxtail; i=NM_NEXT(i, E1000_RBD_SLOTS))
+     the_e1000->rbd[i]->status = 0;
+   the_e1000->rbd_tail = (the_e1000->nm_rxtail + E1000_RBD_SLOTS - 1) % E1000_RBD_SLOTS;
+   e1000_reg_write(E1000_RDT, the_e1000->rbd_tail, the_e1000);
+   the_e1000->tbd_tail = the_e1000->nm_txhead;
+   the_e1000->nm = 0;
+   release(&the_e1000->lock);
+
+   unmapuvm(pgdir, va, E1000_NM_PAGES*PGSIZE);
+   kfree((char*)nm);
+ }
+
+ // Hand the slots user space advanced head over back to the NIC and
+ // give user space the slots the NIC has finished with.
+ int e1000_nm_sync(void *driver) {
+   struct e1000 *the_e1000 = (struct e1000*)driver;
+   struct nm_if *nm;
+   struct e1000_tbd *t;
+   uint head;
+   int i, n;
+
+   acquire(&the_e1000->lock);
+   if((nm = the_e1000->nm) == 0) {
+     release(&the_e1000->lock);
+     return -1;
+   }
+
+   //TX: the user may only advance head over slots it owns
+   head = nm->tx.head;
+   if(head < E1000_TBD_SLOTS &&
+      NM_DIST(the_e1000->nm_txhead, head, E1000_TBD_SLOTS) <=
+      NM_DIST(the_e1000->nm_txhead, the_e1000->nm_txtail, E1000_TBD_SLOTS)) {
+     for(i=the_e1000->nm_txhead; i!=head; i=NM_NEXT(i, E1000_TBD_SLOTS)) {
+       t = the_e1000->tbd[i];
+       memset(t, 0, sizeof(*t));
+       t->addr = (uint64_t)(uint32_t)V2P(the_e1000->tx_buf[i]);
+       t->length = nm->tx.slot[i].len;
+       if(t->length > sizeof(struct packet_buf))
+         t->length = sizeof(struct packet_buf);
+       t->cmd = E1000_TDESC_CMD_RS | E1000_TDESC_CMD_EOP | E1000_TDESC_CMD_IFCS;
+     }
+     if(head != the_e1000->nm_txhead) {
+       the_e1000->nm_txhead = the_e1000->tbd_tail = head;
+       if(the_e1000->link_up) {
+         the_e1000->tdt = head;
+         e1000_reg_write(E1000_TDT, head, the_e1000);
+       }
+     }
+   }
+   //reclaim sent slots, always keeping the one before head
+   for(i=NM_NEXT(the_e1000->nm_txtail, E1000_TBD_SLOTS);
+       i!=the_e1000->nm_txhead && E1000_TDESC_STATUS_DONE(the_e1000->tbd[i]->status);
+       i=NM_NEXT(i, E1000_TBD_SLOTS))
+     the_e1000->nm_txtail = i;
+   nm->tx.tail = the_e1000->nm_txtail;
+
+   //RX: slots the user released go back to the NIC
+   head = nm->rx.head;
+   if(head < E1000_RBD_SLOTS &&
+      NM_DIST(the_e1000->nm_rxhead, head, E1000_RBD_SLOTS) <=
+      NM_DIST(the_e1000->nm_rxhead, the_e1000->nm_rxtail, E1000_RBD_SLOTS) &&
+      head != the_e1000->nm_rxhead) {
+     for(i=the_e1000->nm_rxhead; i!=head; i=NM_NEXT(i, E1000_RBD_SLOTS)) {
+       the_e1000->rbd[i]->status = 0;
+       the_e1000->rbd[i]->errors = 0;
+     }
+     the_e1000->nm_rxhead = head;
+     the_e1000->rbd_tail = (head + E1000_RBD_SLOTS - 1) % E1000_RBD_SLOTS;
+     e1000_reg_write(E1000_RDT, the_e1000->rbd_tail, the_e1000);
+   }
+   //and received frames go to the user
+   for(i=the_e1000->nm_rxtail;
+       i!=(the_e1000->nm_rxhead + E1000_RBD_SLOTS - 1) % E1000_RBD_SLOTS &&
+       (the_e1000->rbd[i]->status & E1000_RXD_STAT_DD);
+       i=NM_NEXT(i, E1000_RBD_SLOTS)) {
+     nm->rx.slot[i].len = the_e1000->rbd[i]->length;
+     nm->rx.slot[i].flags = the_e1000->rbd[i]->errors;
+     the_e1000->nm_rxtail = NM_NEXT(i, E1000_RBD_SLOTS);
+   }
+   nm->rx.tail = the_e1000->nm_rxtail;
+   n = NM_DIST(the_e1000->nm_rxhead, the_e1000->nm_rxtail, E1000_RBD_SLOTS);
+   release(&the_e1000->lock);
+   return n;
+ }
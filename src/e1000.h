@@ -4,12 +4,16 @@
 #include "types.h"
 #include "nic.h"
 #include "pci.h"
+#include "spinlock.h"
 
  #define E1000_VENDOR 0x8086
  #define E1000_DEVICE 0x100E
 
  #define E1000_RBD_SLOTS			128
  #define E1000_TBD_SLOTS			128
+ //log2 of the pages of packet buffers for each ring, from kallocpages()
+ #define E1000_TXBUF_ORDER		6	//E1000_TBD_SLOTS/2 pages
+ #define E1000_RXBUF_ORDER		7	//E1000_RBD_SLOTS pages
 
  //Bit 31:20 are not writable. Always read 0b.
  #define E1000_IOADDR_OFFSET 0x00000000
@@ -25,16 +29,33 @@
  #define E1000_CNTRL_RST_MASK      0x04000000
  #define E1000_CNTRL_ASDE_MASK     0x00000020
  #define E1000_CNTRL_SLU_MASK      0x00000040
+ #define E1000_CNTRL_VME_MASK      0x40000000  //VLAN mode enable
 
 
 #define E1000_CNTRL_RST_BIT(cntrl) \
         (cntrl & E1000_CNTRL_RST_MASK)
 
+ #define E1000_RESET_TIMEOUT 10000  //polls of ~3us for RST to self-clear
+ #define E1000_EERD_TIMEOUT  10000  //polls of ~1us for an EEPROM read
+ #define E1000_TX_TIMEOUT    100000 //polls of ~2us for a descriptor to complete
+
+ /**
+  * Ethernet Device Status and interrupt registers
+  */
+ #define E1000_STATUS        0x00008
+ #define E1000_STATUS_LU     0x00000002  //link up
+ #define E1000_ICR           0x000C0     //interrupt cause, clear on read
+ #define E1000_IMC           0x000D8     //interrupt mask clear
+
  /**
   * Ethernet Device registers
   */
  #define E1000_RCV_RAL0      0x05400
  #define E1000_RCV_RAH0      0x05404
+ #define E1000_RCV_RAL(n)    (E1000_RCV_RAL0 + 8*(n))
+ #define E1000_RCV_RAH(n)    (E1000_RCV_RAH0 + 8*(n))
+ #define E1000_RCV_RAR_SLOTS 16
+ #define E1000_RAH_AV        0x80000000   //address valid
  #define E1000_TDBAL         0x03800
  #define E1000_TDBAH         0x03804
  #define E1000_TDLEN         0x03808
@@ -92,6 +113,17 @@
  #define E1000_IMS_RXT0            0x00000080
 
  #define E1000_MTA                 0X05200
+ #define E1000_MTA_ENTRIES         128       //4096 hash bits
+ #define E1000_NMCAST              16        //multicast groups joined at once
+
+ /**
+  * 802.1Q VLAN registers
+  */
+ #define E1000_VET                 0x00038   //VLAN ether type
+ #define E1000_VFTA                0x05600   //VLAN filter table array
+ #define E1000_VFTA_ENTRIES        128       //32 VLAN ids per entry
+ #define E1000_VLAN_ETHERTYPE      0x8100
+ #define E1000_VLAN_VID_MASK       0x0fff
 
  /**
   * Ethernet Device Receive Control register
@@ -103,6 +135,7 @@
  #define E1000_RCTL_BSIZE          0x00000000
  #define E1000_RCTL_SECRC          0x04000000
  #define E1000_RCTL_UPE            0x00000008
+ #define E1000_RCTL_MPE            0x00000010
 
  #define E1000_RCTL_LBM_MAC        0x00000040
  #define E1000_RCTL_LBM_SLP        0x00000080
@@ -115,6 +148,7 @@
  #define E1000_TDESC_CMD_RS      0x08
  #define E1000_TDESC_CMD_EOP     0x01
  #define E1000_TDESC_CMD_IFCS    0x02
+ #define E1000_TDESC_CMD_VLE     0x40    //insert the VLAN tag in special
 
  /**
   * Ethernet Device Transmit Descriptor Status Field
@@ -158,6 +192,7 @@
  #define E1000_TXD_STAT_DD    0x00000001 /* Descriptor Done */
  #define E1000_RXD_STAT_DD       0x01    /* Descriptor Done */
  #define E1000_RXD_STAT_EOP      0x02    /* End of Packet */
+ #define E1000_RXD_STAT_VP       0x08    /* VLAN tag stripped into special */
 
  //Trasmit Buffer Descriptor
  // The Transmit Descriptor Queue must be aligned on 16-byte boundary
@@ -210,13 +245,34 @@
    uint8_t irq_line;
    uint8_t irq_pin;
    uint8_t mac_addr[6];
+
+   uint16_t tx_vlan;                    //TCI inserted into sent frames, 0 for none
+   uint32_t vfta[E1000_VFTA_ENTRIES];   //shadow of the VLAN filter table
+
+   uint8_t mcast[E1000_NMCAST][6];      //joined multicast groups, hashed into the MTA
+   int nmcast;
+
+   struct spinlock lock;                //protects the rings and registers
+   int link_up;                         //TX queue is paused while 0
+   int tdt;                             //last tail handed to the hardware
+   uint tx_drops;                       //frames dropped while the link was down
+   uint tx_resets;                      //TX ring resets after a timeout
+   uint rx_errors;                      //descriptors recycled with errors
+   uint rx_overruns;                    //RXO interrupts
+
+   struct nm_if *nm;                    //shadow rings while mapped by netmap()
+   int nm_rxhead, nm_rxtail;            //trusted copies of the user's ring
+   int nm_txhead, nm_txtail;            //indices, see netmap.h
  };
 
  int e1000_init(struct pci_func *pcif, void **driver, uint8_t *mac_addr);
 
  void e1000_send(void *e1000, uint8_t* pkt, uint16_t length);
  void e1000_recv(void *e1000, uint8_t* pkt, uint16_t *length);
- void e100_intr(void);
- void udelay(unsigned int u);
+ int e1000_ctl(void *e1000, int op, int arg, uint8_t *addr);
+ int e1000_nm_attach(void *e1000, pde_t *pgdir, uint va);
+ void e1000_nm_detach(void *e1000, pde_t *pgdir, uint va);
+ int e1000_nm_sync(void *e1000);
+ void e1000_intr(void);
 
 #endif
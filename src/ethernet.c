@@ -0,0 +1,83 @@
+// Receive-side demultiplexing. Protocols register a handler for
+// their ethertype once at boot; each received frame is then looked
+// at exactly once, here, and handed to the matching handler.
+
+#include "types.h"
+#include "defs.h"
+#include "arp_frame.h"
+#include "ethernet.h"
+#include "ip.h"
+
+static struct {
+  uint16_t ethertype;
+  eth_handler_t handler;
+} ethtypes[NETHTYPE];
+
+static int nethtypes;
+
+// Register handler for frames carrying ethertype (host byte order).
+// Only called during boot, before any frame is received.
+int
+eth_register(uint16_t ethertype, eth_handler_t handler)
+{
+  int i;
+
+  for(i = 0; i < nethtypes; i++)
+    if(ethtypes[i].ethertype == ethertype)
+      return -1;
+  if(nethtypes == NETHTYPE)
+    return -1;
+  ethtypes[nethtypes].ethertype = ethertype;
+  ethtypes[nethtypes].handler = handler;
+  nethtypes++;
+  return 0;
+}
+
+// Dispatch one received frame to the registered protocol or, failing
+// that, to the packet socket bound to its ethertype. Returns 1 if
+// either consumed it, 0 if nobody claims its ethertype (the caller
+// may then hand the frame to user space as-is).
+int
+eth_input(struct nic_device *nd, uint8_t *frame, uint16_t length)
+{
+  uint16_t ethertype;
+  int i;
+
+  if(length < ETH_HDR_LEN)
+    return 1;  // runt: nothing to deliver
+  ethertype = ntohs(*(uint16_t*)(frame + 2*ETH_ADDR_LEN));
+  for(i = 0; i < nethtypes; i++){
+    if(ethtypes[i].ethertype == ethertype){
+      ethtypes[i].handler(nd, frame, length);
+      return 1;
+    }
+  }
+  return sock_input(nd, frame, length);
+}
+
+// Drain the receive queue of nd through eth_input, using frame as
+// scratch space for one NIC_FRAME_MAX frame.
+// Returns the number of frames processed.
+int
+net_poll(struct nic_device *nd, uint8_t *frame)
+{
+  uint16_t length;
+  int n;
+
+  for(n = 0; ; n++){
+    nd->recv_packet(nd->driver, frame, &length);
+    if(length == 0)
+      break;
+    eth_input(nd, frame, length);
+  }
+  return n;
+}
+
+void
+netinit(void)
+{
+  nicinit();
+  sockinit();
+  arpinit();
+  ipinit();
+}
@@ -0,0 +1,23 @@
+#ifndef __XV6_NETSTACK_ETHERNET_H__
+#define __XV6_NETSTACK_ETHERNET_H__
+
+#include "types.h"
+#include "nic.h"
+
+#define ETH_ADDR_LEN      6
+#define ETH_HDR_LEN       14
+#define ETH_TYPE_IPV4     0x0800
+#define ETH_TYPE_ARP      0x0806
+
+#define NETHTYPE          8     // maximum number of registered ethertypes
+
+// Handler for every received frame of one ethertype. frame points at
+// the ethernet header; length covers the whole frame.
+typedef void (*eth_handler_t)(struct nic_device *nd, uint8_t *frame, uint16_t length);
+
+int  eth_register(uint16_t ethertype, eth_handler_t handler);
+int  eth_input(struct nic_device *nd, uint8_t *frame, uint16_t length);
+int  net_poll(struct nic_device *nd, uint8_t *frame);
+void netinit(void);
+
+#endif
@@ -9,6 +9,8 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "stat.h"
+#include "poll.h"
 
 struct devsw devsw[NDEV];
 struct {
@@ -72,6 +74,8 @@ fileclose(struct file *f)
 
   if(ff.type == FD_PIPE)
     pipeclose(ff.pipe, ff.writable);
+  else if(ff.type == FD_SOCK)
+    sockclose(ff.sock);
   else if(ff.type == FD_INODE){
     begin_op();
     iput(ff.ip);
@@ -102,6 +106,8 @@ fileread(struct file *f, char *addr, int n)
     return -1;
   if(f->type == FD_PIPE)
     return piperead(f->pipe, addr, n);
+  if(f->type == FD_SOCK)
+    return sockread(f->sock, addr, n);
   if(f->type == FD_INODE){
     ilock(f->ip);
     if((r = readi(f->ip, addr, f->off, n)) > 0)
@@ -123,6 +129,8 @@ filewrite(struct file *f, char *addr, int n)
     return -1;
   if(f->type == FD_PIPE)
     return pipewrite(f->pipe, addr, n);
+  if(f->type == FD_SOCK)
+    return sockwrite(f->sock, addr, n);
   if(f->type == FD_INODE){
     // write a few blocks at a time to avoid exceeding
     // the maximum log transaction size, including
@@ -155,3 +163,32 @@ filewrite(struct file *f, char *addr, int n)
   panic("filewrite");
 }
 
+// Report the POLL* events f is ready for. If pe is not 0, also link
+// it into the wait queue of the object behind f, so the poller is
+// woken when that changes.
+int
+filepoll(struct file *f, struct pollent *pe)
+{
+  int r = 0;
+  short type, major;
+
+  if(f->type == FD_PIPE)
+    r = pipepoll(f->pipe, f->writable, pe);
+  else if(f->type == FD_SOCK)
+    r = sockpoll(f->sock, pe);
+  else if(f->type == FD_INODE){
+    ilock(f->ip);
+    type = f->ip->type;
+    major = f->ip->major;
+    iunlock(f->ip);
+    if(type == T_DEV && major >= 0 && major < NDEV && devsw[major].poll)
+      r = devsw[major].poll(f->ip, pe);
+    else
+      r = POLLIN | POLLOUT;   // files never block
+  }
+  if(!f->readable)
+    r &= ~POLLIN;
+  if(!f->writable)
+    r &= ~POLLOUT;
+  return r;
+}
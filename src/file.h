@@ -1,10 +1,11 @@
 struct file {
-  enum { FD_NONE, FD_PIPE, FD_INODE } type;
+  enum { FD_NONE, FD_PIPE, FD_INODE, FD_SOCK } type;
   int ref; // reference count
   char readable;
   char writable;
   struct pipe *pipe;
   struct inode *ip;
+  struct sock *sock;
   uint off;
 };
 
@@ -30,6 +31,7 @@ struct inode {
 struct devsw {
   int (*read)(struct inode*, char*, int);
   int (*write)(struct inode*, char*, int);
+  int (*poll)(struct inode*, struct pollent*);   // optional, see filepoll()
 };
 
 extern struct devsw devsw[];
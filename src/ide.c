@@ -24,6 +24,13 @@
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
 
+#define IDE_TIMEOUT   1000000000ULL  // ns before giving up on a busy drive
+#define IDE_PROBE     10000000ULL    // ns to wait for disk 1 to answer
+// Status reads before giving up anyway, in case nsecs() is not moving
+// (no calibrated clock, and interrupts off).
+#define IDE_SPINS     10000000
+#define IDE_PROBES    100000
+
 // idequeue points to the buf now being read/written to the disk.
 // idequeue->qnext points to the next buf to be processed.
 // You must hold idelock while manipulating queue.
@@ -38,10 +45,12 @@ static void idestart(struct buf*);
 static int
 idewait(int checkerr)
 {
-  int r;
+  int r, n;
+  uint64_t deadline = nsecs() + IDE_TIMEOUT;
 
-  while(((r = inb(0x1f7)) & (IDE_BSY|IDE_DRDY)) != IDE_DRDY)
-    ;
+  for(n = 0; ((r = inb(0x1f7)) & (IDE_BSY|IDE_DRDY)) != IDE_DRDY; n++)
+    if(nsecs() > deadline || n >= IDE_SPINS)
+      return -1;
   if(checkerr && (r & (IDE_DF|IDE_ERR)) != 0)
     return -1;
   return 0;
@@ -50,7 +59,8 @@ idewait(int checkerr)
 void
 ideinit(void)
 {
-  int i;
+  uint64_t deadline;
+  int n;
 
   initlock(&idelock, "ide");
   ioapicenable(IRQ_IDE, ncpu - 1);
@@ -58,11 +68,14 @@ ideinit(void)
 
   // Check if disk 1 is present
   outb(0x1f6, 0xe0 | (1<<4));
-  for(i=0; i<1000; i++){
+  deadline = nsecs() + IDE_PROBE;
+  for(n = 0; n < IDE_PROBES; n++){
     if(inb(0x1f7) != 0){
       havedisk1 = 1;
       break;
     }
+    if(nsecs() >= deadline)
+      break;
   }
 
   // Switch back to disk 0.
@@ -84,7 +97,8 @@ idestart(struct buf *b)
 
   if (sector_per_block > 7) panic("idestart");
 
-  idewait(0);
+  if(idewait(0) < 0)
+    panic("idestart: disk not ready");
   outb(0x3f6, 0);  // generate interrupt
   outb(0x1f2, sector_per_block);  // number of sectors
   outb(0x1f3, sector & 0xff);
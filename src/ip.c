@@ -0,0 +1,94 @@
+// IPv4 receive path: validate the header once and hand the payload
+// to the handler registered for its protocol number.
+
+#include "types.h"
+#include "defs.h"
+#include "spinlock.h"
+#include "arp_frame.h"
+#include "ethernet.h"
+#include "ip.h"
+
+static struct {
+  uint8_t proto;
+  ip_handler_t handler;
+} ipprotos[NIPPROTO];
+
+static int nipprotos;
+
+// Only called during boot, before any frame is received.
+int
+ip_register(uint8_t proto, ip_handler_t handler)
+{
+  int i;
+
+  for(i = 0; i < nipprotos; i++)
+    if(ipprotos[i].proto == proto)
+      return -1;
+  if(nipprotos == NIPPROTO)
+    return -1;
+  ipprotos[nipprotos].proto = proto;
+  ipprotos[nipprotos].handler = handler;
+  nipprotos++;
+  return 0;
+}
+
+static void
+ip_input(struct nic_device *nd, uint8_t *frame, uint16_t length)
+{
+  struct ip_hdr *ip;
+  uint hlen, tlen;
+  int i;
+
+  if(length < ETH_HDR_LEN + sizeof(*ip))
+    return;
+  ip = (struct ip_hdr*)(frame + ETH_HDR_LEN);
+  hlen = (ip->ver_ihl & 0xf) * 4;
+  tlen = ntohs(ip->total_len);
+  if((ip->ver_ihl >> 4) != 4 || hlen < sizeof(*ip) ||
+     tlen < hlen || ETH_HDR_LEN + tlen > length)
+    return;
+  if(ntohs(ip->frag) & 0x3fff)
+    return;  // fragments are not reassembled
+
+  for(i = 0; i < nipprotos; i++){
+    if(ipprotos[i].proto == ip->proto){
+      ipprotos[i].handler(nd, ip, (uint8_t*)ip + hlen, tlen - hlen);
+      return;
+    }
+  }
+}
+
+static struct {
+  struct spinlock lock;
+  uint replies;
+} icmpstat;
+
+static void
+icmp_input(struct nic_device *nd, struct ip_hdr *ip, uint8_t *payload, uint16_t length)
+{
+  if(length < 8 || payload[0] != ICMP_ECHO_REPLY)
+    return;
+  acquire(&icmpstat.lock);
+  icmpstat.replies++;
+  release(&icmpstat.lock);
+}
+
+// Number of ICMP echo replies received since boot.
+uint
+icmp_echo_replies(void)
+{
+  uint n;
+
+  acquire(&icmpstat.lock);
+  n = icmpstat.replies;
+  release(&icmpstat.lock);
+  return n;
+}
+
+void
+ipinit(void)
+{
+  initlock(&icmpstat.lock, "icmp");
+  eth_register(ETH_TYPE_IPV4, ip_input);
+  ip_register(IP_PROTO_ICMP, icmp_input);
+}
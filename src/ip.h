@@ -0,0 +1,37 @@
+#ifndef __XV6_NETSTACK_IP_H__
+#define __XV6_NETSTACK_IP_H__
+
+#include "types.h"
+#include "nic.h"
+
+#define IP_PROTO_ICMP     1
+#define IP_PROTO_UDP      17
+
+#define NIPPROTO          8     // maximum number of registered IP protocols
+
+#define ICMP_ECHO_REPLY   0
+#define ICMP_ECHO_REQUEST 8
+
+struct ip_hdr {
+  uint8_t  ver_ihl;     // version << 4 | header length in words
+  uint8_t  tos;
+  uint16_t total_len;
+  uint16_t id;
+  uint16_t frag;
+  uint8_t  ttl;
+  uint8_t  proto;
+  uint16_t checksum;
+  uint32_t src;
+  uint32_t dst;
+} __attribute__((packed));
+
+// Handler for IPv4 datagrams of one protocol. payload and length
+// describe the data following the (already validated) IP header.
+typedef void (*ip_handler_t)(struct nic_device *nd, struct ip_hdr *ip,
+                             uint8_t *payload, uint16_t length);
+
+int  ip_register(uint8_t proto, ip_handler_t handler);
+void ipinit(void);
+uint icmp_echo_replies(void);
+
+#endif
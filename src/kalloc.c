@@ -1,13 +1,41 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
-// and pipe buffers. Allocates 4096-byte pages.
+// and pipe buffers. Allocates 4096-byte pages, and runs of
+// 2^order physically contiguous pages for device rings and buffers.
+//
+// The shared pool is a buddy allocator: free memory is kept in
+// aligned blocks of 2^order pages, one list per order. A block is
+// split to satisfy a smaller request and merged with its buddy, the
+// block it was split from, when both are free again.
+//
+// Each CPU keeps a private cache of free pages so that most kalloc()
+// and kfree() calls never touch the shared pool. A CPU whose cache
+// runs dry refills it with a batch from the pool, or steals half of
+// another CPU's cache when the pool is empty; a cache that grows too
+// large drains a batch back to the pool.
+//
+// A page may be mapped by several processes after a copy-on-write
+// fork. kalloc() gives a page one reference, kref() adds one, and
+// kfree() only frees the page when it drops the last.
+//
+// Pages are not cleared when freed. Callers that need a zeroed page
+// use kzalloc(), which takes one from a small pool that idle CPUs
+// keep topped up, so the memset is usually off the critical path.
+// Building with -DKALLOC_DEBUG fills freed pages with junk instead,
+// and checks that nothing wrote to a zeroed page while it was free.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "x86.h"
 #include "spinlock.h"
+#include "kmemstat.h"
+
+#define KCACHE_BATCH  16                  // pages moved to or from the pool at once
+#define KCACHE_HIGH   (4*KCACHE_BATCH)    // a cache drains down from here
+#define KZERO_TARGET  64                  // zeroed pages kept ready
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
@@ -17,21 +45,67 @@ struct run {
   struct run *next;
 };
 
+// A free block in the pool. pgorder[] has BLOCK_FREE|order for the
+// first page of every free block and 0 for every other page.
+struct block {
+  struct block *next;
+  struct block *prev;
+};
+
+#define BLOCK_FREE  0x80
+#define NPHYSPAGES  (PHYSTOP / PGSIZE)
+
+static uchar pgorder[NPHYSPAGES];
+static ushort pgref[NPHYSPAGES];   // 0 for a free page
+
+// A CPU's cache. Its lock is only contended by thieves; the counters
+// are only written by the owning CPU, with interrupts off.
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int nfree;
+  uint allocs;
+  uint frees;
+  uint refills;
+  uint drains;
+  uint steals;
+};
+
 struct {
   struct spinlock lock;
   int use_lock;
-  struct run *freelist;
+  struct block *free[KMEM_ORDERS];
+  uint nblocks[KMEM_ORDERS];
+  int nfree;          // pages in the pool
+  uint acquired;      // times lock was taken
+  uint contended;     // ... and found held by another CPU
+  struct kcache cache[NCPU];
 } kmem;
 
+struct {
+  struct spinlock lock;
+  struct run *freelist;   // zeroed but for the link word
+  int nfree;
+  uint hits;
+  uint misses;
+} kzero;
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
 // 2. main() calls kinit2() with the rest of the physical pages
 // after installing a full page table that maps them on all cores.
+// Until kinit2() finishes only the boot CPU allocates, straight from
+// the pool.
 void
 kinit1(void *vstart, void *vend)
 {
+  int i;
+
   initlock(&kmem.lock, "kmem");
+  initlock(&kzero.lock, "kzero");
+  for(i = 0; i < NCPU; i++)
+    initlock(&kmem.cache[i].lock, "kcache");
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -51,6 +125,160 @@ freerange(void *vstart, void *vend)
   for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
     kfree(p);
 }
+
+static void
+blockpush(struct block *b, int order)
+{
+  b->prev = 0;
+  b->next = kmem.free[order];
+  if(b->next)
+    b->next->prev = b;
+  kmem.free[order] = b;
+  kmem.nblocks[order]++;
+  pgorder[V2P(b) / PGSIZE] = BLOCK_FREE | order;
+}
+
+static void
+blockdel(struct block *b, int order)
+{
+  if(b->prev)
+    b->prev->next = b->next;
+  else
+    kmem.free[order] = b->next;
+  if(b->next)
+    b->next->prev = b->prev;
+  kmem.nblocks[order]--;
+  pgorder[V2P(b) / PGSIZE] = 0;
+}
+
+// Return the 2^order pages at v to the pool, merging them with their
+// buddy for as long as it is free too. Caller holds kmem.lock.
+static void
+buddyfree(char *v, int order)
+{
+  uint pfn = V2P(v) / PGSIZE, bpfn;
+
+  kmem.nfree += 1 << order;
+  for(; order < KMEM_ORDERS - 1; order++){
+    bpfn = pfn ^ (1 << order);
+    if(bpfn >= NPHYSPAGES || pgorder[bpfn] != (BLOCK_FREE | order))
+      break;
+    blockdel((struct block*)P2V(bpfn * PGSIZE), order);
+    pfn &= ~(1 << order);
+  }
+  blockpush((struct block*)P2V(pfn * PGSIZE), order);
+}
+
+// Take 2^order contiguous pages from the pool, splitting the smallest
+// free block that is large enough. Caller holds kmem.lock.
+static char*
+buddyalloc(int order)
+{
+  struct block *b;
+  int o;
+
+  for(o = order; o < KMEM_ORDERS && kmem.free[o] == 0; o++)
+    ;
+  if(o == KMEM_ORDERS)
+    return 0;
+  b = kmem.free[o];
+  blockdel(b, o);
+  // put back the upper half until the block is the size asked for
+  while(o > order){
+    o--;
+    blockpush((struct block*)((char*)b + (PGSIZE << o)), o);
+  }
+  kmem.nfree -= 1 << order;
+  return (char*)b;
+}
+
+static void
+poollock(void)
+{
+  int busy = lockbusy(&kmem.lock);
+
+  acquire(&kmem.lock);
+  kmem.acquired++;
+  if(busy)
+    kmem.contended++;
+}
+
+// Detach up to n pages from the front of *list and return them.
+// *cnt is decremented by the number taken, which is stored in *got.
+static struct run*
+take(struct run **list, int *cnt, int n, int *got)
+{
+  struct run *first, *last;
+  int i;
+
+  if((first = *list) == 0 || n <= 0){
+    *got = 0;
+    return 0;
+  }
+  last = first;
+  for(i = 1; i < n && last->next; i++)
+    last = last->next;
+  *list = last->next;
+  last->next = 0;
+  *cnt -= i;
+  *got = i;
+  return first;
+}
+
+// Link list, of n pages, onto the front of *head.
+static void
+splice(struct run **head, int *cnt, struct run *list, int n)
+{
+  struct run *last;
+
+  if(list == 0)
+    return;
+  for(last = list; last->next; last = last->next)
+    ;
+  last->next = *head;
+  *head = list;
+  *cnt += n;
+}
+
+// Find pages for c, which is empty: a batch from the pool or else
+// half of another CPU's cache. Called without c->lock held and with
+// interrupts off; stores the number of pages found in *n.
+static struct run*
+refill(struct kcache *c, int *n)
+{
+  struct kcache *v;
+  struct run *list = 0, *r;
+
+  poollock();
+  for(*n = 0; *n < KCACHE_BATCH && (r = (struct run*)buddyalloc(0)) != 0; (*n)++){
+    r->next = list;
+    list = r;
+  }
+  release(&kmem.lock);
+  if(list){
+    c->refills++;
+    return list;
+  }
+
+  for(v = kmem.cache; v < &kmem.cache[NCPU]; v++){
+    if(v == c || v->nfree == 0)
+      continue;
+    acquire(&v->lock);
+    list = take(&v->freelist, &v->nfree, (v->nfree + 1) / 2, n);
+    release(&v->lock);
+    if(list){
+      c->steals++;
+      return list;
+    }
+  }
+
+  // Last resort: the pages kept zeroed for kzalloc().
+  acquire(&kzero.lock);
+  list = take(&kzero.freelist, &kzero.nfree, KCACHE_BATCH, n);
+  release(&kzero.lock);
+  return list;
+}
+
 //PAGEBREAK: 21
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
@@ -59,21 +287,47 @@ freerange(void *vstart, void *vend)
 void
 kfree(char *v)
 {
-  struct run *r;
+  struct kcache *c;
+  struct run *r, *batch = 0;
+  int n = 0;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
+  // Only the last reference frees; freerange()'s pages have none.
+  if(pgref[V2P(v) / PGSIZE] && __sync_sub_and_fetch(&pgref[V2P(v) / PGSIZE], 1) > 0)
+    return;
 
+#ifdef KALLOC_DEBUG
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
+#endif
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
   r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  if(kmem.use_lock)
+  if(!kmem.use_lock){
+    buddyfree(v, 0);
+    return;
+  }
+
+  pushcli();
+  c = &kmem.cache[cpuid()];
+  acquire(&c->lock);
+  r->next = c->freelist;
+  c->freelist = r;
+  c->nfree++;
+  c->frees++;
+  if(c->nfree > KCACHE_HIGH)
+    batch = take(&c->freelist, &c->nfree, KCACHE_BATCH, &n);
+  release(&c->lock);
+  if(batch){
+    poollock();
+    for(; batch; batch = r){
+      r = batch->next;
+      buddyfree((char*)batch, 0);
+    }
     release(&kmem.lock);
+    c->drains++;
+  }
+  popcli();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -82,15 +336,184 @@ kfree(char *v)
 char*
 kalloc(void)
 {
-  struct run *r;
+  struct kcache *c;
+  struct run *r, *list;
+  int n;
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  if(kmem.use_lock)
-    release(&kmem.lock);
+  if(!kmem.use_lock){
+    if((r = (struct run*)buddyalloc(0)) != 0)
+      pgref[V2P(r) / PGSIZE] = 1;
+    return (char*)r;
+  }
+
+  pushcli();
+  c = &kmem.cache[cpuid()];
+  acquire(&c->lock);
+  while((r = c->freelist) == 0){
+    release(&c->lock);
+    if((list = refill(c, &n)) == 0){
+      popcli();
+      return 0;
+    }
+    acquire(&c->lock);
+    splice(&c->freelist, &c->nfree, list, n);
+  }
+  c->freelist = r->next;
+  c->nfree--;
+  c->allocs++;
+  release(&c->lock);
+  popcli();
+  pgref[V2P(r) / PGSIZE] = 1;
   return (char*)r;
 }
 
+// Add a reference to the page at v, which is allocated.
+void
+kref(char *v)
+{
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP || pgref[V2P(v) / PGSIZE] == 0)
+    panic("kref");
+  __sync_fetch_and_add(&pgref[V2P(v) / PGSIZE], 1);
+}
+
+// Number of references to the page at v.
+int
+krefcount(char *v)
+{
+  return pgref[V2P(v) / PGSIZE];
+}
+
+// Allocate 2^order physically contiguous pages, aligned to their
+// size. Returns 0 if no free block is large enough.
+char*
+kallocpages(int order)
+{
+  char *v;
+
+  if(order == 0)
+    return kalloc();
+  if(order < 0 || order >= KMEM_ORDERS)
+    return 0;
+  poollock();
+  v = buddyalloc(order);
+  release(&kmem.lock);
+  return v;
+}
+
+// Free 2^order pages returned by kallocpages(order).
+void
+kfreepages(char *v, int order)
+{
+  if(order == 0){
+    kfree(v);
+    return;
+  }
+  if(order < 0 || order >= KMEM_ORDERS || V2P(v) % (PGSIZE << order) ||
+     v < end || V2P(v) + (PGSIZE << order) > PHYSTOP)
+    panic("kfreepages");
+#ifdef KALLOC_DEBUG
+  memset(v, 1, PGSIZE << order);
+#endif
+  poollock();
+  buddyfree(v, order);
+  release(&kmem.lock);
+}
+
+// Allocate a page filled with zeros.
+char*
+kzalloc(void)
+{
+  struct run *r = 0;
+#ifdef KALLOC_DEBUG
+  uint *w;
+#endif
+
+  if(kmem.use_lock){
+    acquire(&kzero.lock);
+    if((r = kzero.freelist) != 0){
+      kzero.freelist = r->next;
+      kzero.nfree--;
+      kzero.hits++;
+    } else
+      kzero.misses++;
+    release(&kzero.lock);
+  }
+  if(r){
+    r->next = 0;
+    pgref[V2P(r) / PGSIZE] = 1;
+#ifdef KALLOC_DEBUG
+    for(w = (uint*)r; w < (uint*)((char*)r + PGSIZE); w++)
+      if(*w)
+        panic("kzalloc: free page written");
+#endif
+    return (char*)r;
+  }
+  if((r = (struct run*)kalloc()) != 0)
+    memset(r, 0, PGSIZE);
+  return (char*)r;
+}
+
+// Called by a CPU with nothing to run: zero a page for kzalloc() if
+// the zeroed pool is short and memory is not. Returns 1 if it did.
+int
+kzeroidle(void)
+{
+  struct run *r;
+
+  if(!kmem.use_lock || kzero.nfree >= KZERO_TARGET || kmem.nfree < KZERO_TARGET)
+    return 0;
+  if((r = (struct run*)kalloc()) == 0)
+    return 0;
+  memset(r, 0, PGSIZE);
+  acquire(&kzero.lock);
+  r->next = kzero.freelist;
+  kzero.freelist = r;
+  kzero.nfree++;
+  release(&kzero.lock);
+  return 1;
+}
+
+// Number of free pages, read without locks: only an estimate.
+int
+kfreecount(void)
+{
+  struct kcache *c;
+  int n;
+
+  n = kmem.nfree + kzero.nfree;
+  for(c = kmem.cache; c < &kmem.cache[NCPU]; c++)
+    n += c->nfree;
+  return n;
+}
+
+// Snapshot the allocator's counters. The per-CPU numbers are read
+// without their locks and may be slightly stale.
+void
+kmemstat(struct kmemstat *st)
+{
+  struct kcache *c;
+  int i;
+
+  memset(st, 0, sizeof(*st));
+  acquire(&kmem.lock);
+  st->pool = kmem.nfree;
+  for(i = 0; i < KMEM_ORDERS; i++)
+    st->blocks[i] = kmem.nblocks[i];
+  st->acquired = kmem.acquired;
+  st->contended = kmem.contended;
+  release(&kmem.lock);
+  acquire(&kzero.lock);
+  st->zeroed = kzero.nfree;
+  st->zhits = kzero.hits;
+  st->zmisses = kzero.misses;
+  release(&kzero.lock);
+  st->nfree = st->pool + st->zeroed;
+  for(c = kmem.cache; c < &kmem.cache[NCPU]; c++){
+    st->nfree += c->nfree;
+    st->allocs += c->allocs;
+    st->frees += c->frees;
+    st->refills += c->refills;
+    st->drains += c->drains;
+    st->steals += c->steals;
+  }
+}
@@ -0,0 +1,18 @@
+#define KMEM_ORDERS  11   // pool blocks are 2^0 to 2^10 pages (4MB)
+
+// Page allocator counters, returned by the kmemstat system call.
+struct kmemstat {
+  uint nfree;       // free pages, pool and CPU caches
+  uint pool;        // free pages in the shared pool
+  uint acquired;    // times the pool lock was taken
+  uint contended;   // ... and another CPU was holding it
+  uint allocs;      // kalloc() calls satisfied
+  uint frees;       // kfree() calls after boot
+  uint refills;     // batches moved from the pool to a CPU
+  uint drains;      // batches moved from a CPU to the pool
+  uint steals;      // refills taken from another CPU's cache
+  uint zeroed;      // pages zeroed ahead of time, waiting for kzalloc()
+  uint zhits;       // kzalloc() calls that found one
+  uint zmisses;     // ... and that had to clear a page themselves
+  uint blocks[KMEM_ORDERS];   // free pool blocks of each order
+};
@@ -43,6 +43,11 @@
 
 volatile uint *lapic;  // Initialized in mp.c
 
+// Timer counts per microsecond. QEMU's bus runs at 1GHz;
+// lapiccalibrate() measures the real rate.
+static uint lapicmhz = 1000;
+static int lapictick;   // timers tick every TICKNS; see clockticks()
+
 //PAGEBREAK!
 static void
 lapicw(int index, int value)
@@ -60,13 +65,17 @@ lapicinit(void)
   // Enable local APIC; set spurious interrupt vector.
   lapicw(SVR, ENABLE | (T_IRQ0 + IRQ_SPURIOUS));
 
-  // The timer repeatedly counts down at bus frequency
-  // from lapic[TICR] and then issues an interrupt.
-  // If xv6 cared more about precise timekeeping,
-  // TICR would be calibrated using an external time source.
+  // The timer counts down once at bus frequency from lapic[TICR]
+  // and then issues an interrupt; lapicarm() starts it. Without a
+  // clock to arm it by, it repeats every TICKNS instead.
   lapicw(TDCR, X1);
-  lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-  lapicw(TICR, 10000000);
+  if(lapictick){
+    lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
+    lapicw(TICR, TICKNS / 1000 * lapicmhz);
+  } else {
+    lapicw(TIMER, T_IRQ0 + IRQ_TIMER);
+    lapicw(TICR, 0);
+  }
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
@@ -113,11 +122,55 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
-// Spin for a given number of microseconds.
-// On real hardware would want to tune this dynamically.
+// Measure the timer's rate against the TSC, once clockinit() has run.
+void
+lapiccalibrate(void)
+{
+  uint n;
+
+  if(!lapic)
+    return;
+  if(clockticks()){
+    // Nothing to measure against: guess the rate and tick.
+    lapictick = 1;
+    lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
+    lapicw(TICR, TICKNS / 1000 * lapicmhz);
+    cprintf("lapic: no clock, ticking every %d ms\n", TICKNS / 1000000);
+    return;
+  }
+  lapicw(TIMER, MASKED | (T_IRQ0 + IRQ_TIMER));
+  lapicw(TICR, 0xFFFFFFFF);
+  udelay(10000);
+  n = 0xFFFFFFFF - lapic[TCCR];
+  lapicw(TICR, 0);
+  lapicw(TIMER, T_IRQ0 + IRQ_TIMER);
+  if(n >= 10000)
+    lapicmhz = n / 10000;
+  cprintf("lapic: timer at %d MHz\n", lapicmhz);
+}
+
+// Interrupt this CPU once, ns nanoseconds from now; 0 cancels.
+void
+lapicarm(uint64_t ns)
+{
+  uint us;
+
+  if(!lapic || lapictick)
+    return;
+  if(ns > 1000000000)
+    ns = 1000000000;
+  us = ((uint)ns + 999) / 1000;
+  lapicw(TICR, us * lapicmhz);
+}
+
+// Send interrupt vector to the CPU with the given APIC ID.
 void
-microdelay(int us)
+lapicipi(int apicid, int vector)
 {
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
 }
 
 #define CMOS_PORT    0x70
@@ -144,9 +197,9 @@ lapicstartap(uchar apicid, uint addr)
   // Send INIT (level-triggered) interrupt to reset other CPU.
   lapicw(ICRHI, apicid<<24);
   lapicw(ICRLO, INIT | LEVEL | ASSERT);
-  microdelay(200);
+  udelay(200);
   lapicw(ICRLO, INIT | LEVEL);
-  microdelay(100);    // should be 10ms, but too slow in Bochs!
+  udelay(100);    // should be 10ms, but too slow in Bochs!
 
   // Send startup IPI (twice!) to enter code.
   // Regular hardware is supposed to only accept a STARTUP
@@ -156,7 +209,7 @@ lapicstartap(uchar apicid, uint addr)
   for(i = 0; i < 2; i++){
     lapicw(ICRHI, apicid<<24);
     lapicw(ICRLO, STARTUP | (addr>>12));
-    microdelay(200);
+    udelay(200);
   }
 }
 
@@ -174,7 +227,7 @@ lapicstartap(uchar apicid, uint addr)
 static uint cmos_read(uint reg)
 {
   outb(CMOS_PORT,  reg);
-  microdelay(200);
+  udelay(200);
 
   return inb(CMOS_RETURN);
 }
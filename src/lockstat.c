@@ -0,0 +1,75 @@
+// Print spinlock contention, most contended locks first: the totals
+// since boot, or with a command, what changed while it ran (the
+// longest hold is still the longest since boot).
+//
+// usage: lockstat [command [arg...]]
+
+#include "types.h"
+#include "user.h"
+#include "lockstat.h"
+
+#define NNAMES  64
+
+static struct lockstat before[NNAMES], after[NNAMES];
+
+int
+main(int argc, char *argv[])
+{
+  struct lockstat *s, t;
+  int n, nb, i, j, pid;
+
+  nb = 0;
+  if(argc > 1){
+    if((nb = lockstat(before, NNAMES)) < 0){
+      printf(2, "lockstat: lockstat failed\n");
+      exit();
+    }
+    if((pid = fork()) < 0){
+      printf(2, "lockstat: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      exec(argv[1], argv + 1);
+      printf(2, "lockstat: exec %s failed\n", argv[1]);
+      exit();
+    }
+    wait();
+  }
+  if((n = lockstat(after, NNAMES)) < 0){
+    printf(2, "lockstat: lockstat failed\n");
+    exit();
+  }
+
+  for(i = 0; i < n; i++){
+    s = &after[i];
+    for(j = 0; j < nb; j++)
+      if(strcmp(before[j].name, s->name) == 0){
+        s->acquires -= before[j].acquires;
+        s->contended -= before[j].contended;
+        s->spins -= before[j].spins;
+        break;
+      }
+  }
+  // insertion sort by contended acquires, then acquires
+  for(i = 1; i < n; i++){
+    t = after[i];
+    for(j = i; j > 0 && (after[j-1].contended < t.contended ||
+        (after[j-1].contended == t.contended &&
+         after[j-1].acquires < t.acquires)); j--)
+      after[j] = after[j-1];
+    after[j] = t;
+  }
+
+  printf(1, "name            locks\tacquires\tcontended\tspins\tmax hold\n");
+  for(i = 0; i < n; i++){
+    s = &after[i];
+    if(s->acquires == 0)
+      continue;
+    printf(1, "%s", s->name);
+    for(j = strlen(s->name); j < 16; j++)
+      printf(1, " ");
+    printf(1, "%d\t%d\t%d\t%d\t%d\n",
+           s->nlocks, s->acquires, s->contended, s->spins, s->maxhold);
+  }
+  exit();
+}
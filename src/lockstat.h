@@ -0,0 +1,16 @@
+#ifndef XV6_LOCKSTAT_H
+#define XV6_LOCKSTAT_H
+
+// Counters for all the spinlocks with one name, returned by the
+// lockstat system call. Only locks in the kernel's static data are
+// counted, not those in allocated objects such as pipes.
+struct lockstat {
+  char name[16];
+  uint nlocks;      // locks with this name
+  uint acquires;
+  uint contended;   // acquires that found the lock held
+  uint spins;       // turns of the wait loop in those
+  uint maxhold;     // longest any was held, in TSC cycles
+};
+
+#endif // XV6_LOCKSTAT_H
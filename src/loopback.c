@@ -0,0 +1,97 @@
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "loopback.h"
+
+// Two frames fit in each page of slot storage.
+#define LOOPBACK_FRAMES_PER_PAGE  (PGSIZE / 2048)
+
+struct loopback {
+  struct spinlock lock;
+  uint nread;                         // number of frames received
+  uint nwrite;                        // number of frames sent
+  uint drops;                         // frames sent while the queue was full
+  uint16_t len[LOOPBACK_SLOTS];
+  uint8_t *frame[LOOPBACK_SLOTS];     // NIC_FRAME_MAX bytes each
+};
+
+int
+loopback_init(void **driver, uint8_t *mac_addr)
+{
+  struct loopback *lo;
+  char *mem = 0;
+  int i;
+
+  if((lo = (struct loopback*)kalloc()) == 0)
+    return -1;
+  memset(lo, 0, sizeof(*lo));
+  initlock(&lo->lock, "loopback");
+  for(i = 0; i < LOOPBACK_SLOTS; i++){
+    if(i % LOOPBACK_FRAMES_PER_PAGE == 0){
+      if((mem = kalloc()) == 0)
+        panic("loopback_init: out of memory");
+    }
+    lo->frame[i] = (uint8_t*)mem + (i % LOOPBACK_FRAMES_PER_PAGE) * 2048;
+  }
+
+  // The loopback interface has no hardware address.
+  memset(mac_addr, 0, 6);
+  *driver = lo;
+  return 0;
+}
+
+void
+loopback_send(void *driver, uint8_t *pkt, uint16_t length)
+{
+  struct loopback *lo = (struct loopback*)driver;
+
+  if(length > NIC_FRAME_MAX)
+    length = NIC_FRAME_MAX;
+
+  acquire(&lo->lock);
+  if(lo->nwrite == lo->nread + LOOPBACK_SLOTS){
+    // Queue full: drop the frame, as a real NIC would.
+    lo->drops++;
+    release(&lo->lock);
+    return;
+  }
+  memmove(lo->frame[lo->nwrite % LOOPBACK_SLOTS], pkt, length);
+  lo->len[lo->nwrite % LOOPBACK_SLOTS] = length;
+  lo->nwrite++;
+  release(&lo->lock);
+  nic_rxready(lo);
+}
+
+void
+loopback_recv(void *driver, uint8_t *pkt, uint16_t *length)
+{
+  struct loopback *lo = (struct loopback*)driver;
+
+  acquire(&lo->lock);
+  if(lo->nread == lo->nwrite){
+    *length = 0;
+    release(&lo->lock);
+    return;
+  }
+  *length = lo->len[lo->nread % LOOPBACK_SLOTS];
+  memmove(pkt, lo->frame[lo->nread % LOOPBACK_SLOTS], *length);
+  lo->nread++;
+  release(&lo->lock);
+}
+
+// Register the loopback interface as "lo".
+void
+loopbackattach(void)
+{
+  struct nic_device nd;
+
+  memset(&nd, 0, sizeof(nd));
+  safestrcpy(nd.name, "lo", sizeof(nd.name));
+  if(loopback_init(&nd.driver, nd.mac_addr) < 0)
+    panic("loopbackattach");
+  nd.send_packet = loopback_send;
+  nd.recv_packet = loopback_recv;
+  register_device(nd);
+}
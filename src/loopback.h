@@ -0,0 +1,19 @@
+#ifndef __XV6_NETSTACK_LOOPBACK_H__
+#define __XV6_NETSTACK_LOOPBACK_H__
+
+#include "types.h"
+#include "nic.h"
+
+// Software loopback interface. Every frame sent on it is queued
+// and handed back by the next receive, so the network code above
+// the nic_device layer can be exercised and timed without the
+// cost (or the nondeterminism) of an emulated device.
+
+#define LOOPBACK_SLOTS   32   // frames queued before sends are dropped
+
+int  loopback_init(void **driver, uint8_t *mac_addr);
+void loopback_send(void *driver, uint8_t *pkt, uint16_t length);
+void loopback_recv(void *driver, uint8_t *pkt, uint16_t *length);
+void loopbackattach(void);
+
+#endif
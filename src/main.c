@@ -6,6 +6,8 @@
 #include "proc.h"
 #include "x86.h"
 #include "pci.h"
+#include "loopback.h"
+#include "ethernet.h"
 
 static void startothers(void);
 static void mpmain(void)  __attribute__((noreturn));
@@ -22,19 +24,28 @@ main(void)
   kvmalloc();      // kernel page table
   mpinit();        // detect other processors
   lapicinit();     // interrupt controller
+  clockinit();     // calibrate the TSC
+  lapiccalibrate(); // and the local APIC timer
   seginit();       // segment descriptors
   picinit();       // disable pic
   ioapicinit();    // another interrupt controller
   consoleinit();   // console hardware
   uartinit();      // serial port
   pinit();         // process table
+  timerinit();     // kernel timers
   tvinit();        // trap vectors
   binit();         // buffer cache
+  slabinit();      // kernel object caches
   fileinit();      // file table
+  pipeinit();      // pipe cache
+  pollinit();      // poll() wait queues
+  uringinit();     // uring context cache
   ideinit();       // disk 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
+  netinit();       // network protocol handlers
   pci_init();
+  loopbackattach(); // software loopback NIC
   userinit();      // first user process
   mpmain();        // finish this processor's setup
 }
@@ -8,6 +8,12 @@
 #define KERNBASE 0x80000000         // First kernel virtual address
 #define KERNLINK (KERNBASE+EXTMEM)  // Address where kernel is linked
 
+// User memory ends at USERTOP. Between USERTOP and KERNBASE the
+// kernel maps memory it shares with the process (see mapuvm).
+#define USERTOP  0x7F000000
+#define URINGVA  USERTOP            // submission/completion ring
+#define NETMAPVA (USERTOP+0x100000) // NIC rings and packet buffers
+
 #define V2P(a) (((uint) (a)) - KERNBASE)
 #define P2V(a) (((void *) (a)) + KERNBASE)
 
@@ -0,0 +1,38 @@
+// Print the page allocator's counters and how fragmented its free
+// memory is.
+
+#include "types.h"
+#include "user.h"
+#include "kmemstat.h"
+
+int
+main(void)
+{
+  struct kmemstat st;
+  uint inlarge = 0;
+  int i, largest = -1;
+
+  if(kmemstat(&st) < 0){
+    printf(2, "memstat: kmemstat failed\n");
+    exit();
+  }
+  printf(1, "free pages   %d (pool %d, pre-zeroed %d, per-cpu %d)\n",
+         st.nfree, st.pool, st.zeroed, st.nfree - st.pool - st.zeroed);
+  printf(1, "pool lock    %d taken, %d contended\n", st.acquired, st.contended);
+  printf(1, "cpu caches   %d allocs, %d frees, %d refills, %d drains, %d steals\n",
+         st.allocs, st.frees, st.refills, st.drains, st.steals);
+  printf(1, "kzalloc      %d pre-zeroed, %d cleared on demand\n", st.zhits, st.zmisses);
+  printf(1, "order  pages  free blocks\n");
+  for(i = 0; i < KMEM_ORDERS; i++){
+    printf(1, "%d\t%d\t%d\n", i, 1 << i, st.blocks[i]);
+    if(st.blocks[i])
+      largest = i;
+    if(i >= 4)
+      inlarge += st.blocks[i] << i;
+  }
+  // share of the pool that can serve a 16-page (64KB) request
+  if(st.pool)
+    printf(1, "largest free block 2^%d pages; %d%% of the pool in blocks of 16+ pages\n",
+           largest, inlarge * 100 / st.pool);
+  exit();
+}
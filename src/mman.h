@@ -0,0 +1,15 @@
+#ifndef XV6_MMAN_H
+#define XV6_MMAN_H
+
+// mmap() protection
+#define PROT_READ    0x1
+#define PROT_WRITE   0x2
+
+// mmap() flags: exactly one of MAP_SHARED and MAP_PRIVATE
+#define MAP_SHARED   0x1    // writes reach the file and other mappers
+#define MAP_PRIVATE  0x2    // writes stay in this process
+#define MAP_ANON     0x4    // zero-filled memory, no file
+
+#define MAP_FAILED   ((void*)-1)
+
+#endif // XV6_MMAN_H
@@ -0,0 +1,249 @@
+// Memory-mapped files and anonymous memory.
+//
+// Each process has up to NVMA mappings, placed top-down from USERTOP
+// so they stay clear of the heap growing up from p->sz. Pages are
+// filled in on first touch: from the file through readi(), or with
+// zeros for MAP_ANON.
+//
+// MAP_PRIVATE pages are shared copy-on-write across fork like the
+// rest of memory. MAP_SHARED pages are shared outright with children,
+// and a page dirtied through a shared file mapping is written back
+// to the file when it is unmapped, up to the file's current size.
+// Processes that map the same file independently see each other's
+// writes only after they are written back.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "stat.h"
+#include "fs.h"
+#include "file.h"
+#include "mman.h"
+
+// The mapping of p containing va, or 0.
+struct vma*
+vmalookup(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len && va >= v->va && va < v->va + v->len)
+      return v;
+  return 0;
+}
+
+// Lowest address of any mapping: the heap may not grow past it.
+uint
+vmabase(struct proc *p)
+{
+  struct vma *v;
+  uint base = USERTOP;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len && v->va < base)
+      base = v->va;
+  return base;
+}
+
+// Find len bytes of unused address space, as high as possible.
+static uint
+vmaplace(struct proc *p, uint len)
+{
+  struct vma *v;
+  uint va = USERTOP - len;
+
+  for(;;){
+    if(va < PGROUNDUP(p->sz) || va > USERTOP)
+      return 0;
+    for(v = p->vma; v < &p->vma[NVMA]; v++)
+      if(v->len && va < v->va + v->len && va + len > v->va)
+        break;
+    if(v == &p->vma[NVMA])
+      return va;
+    va = v->va - len;
+  }
+}
+
+// Write a page of a shared file mapping back to its file.
+static void
+writeback(struct vma *v, uint va, char *page)
+{
+  struct inode *ip = v->f->ip;
+  uint off = v->off + (va - v->va), n;
+
+  begin_op();
+  ilock(ip);
+  if(off < ip->size){
+    n = ip->size - off;
+    if(n > PGSIZE)
+      n = PGSIZE;
+    writei(ip, page, off, n);
+  }
+  iunlock(ip);
+  end_op();
+}
+
+// Remove the pages of [va, va+len) in v from p's page table, writing
+// dirty shared file pages back first. Caller flushes the TLB.
+static void
+vmaunmap(struct proc *p, struct vma *v, uint va, uint len)
+{
+  pte_t *pte;
+  uint a;
+
+  for(a = va; a < va + len; a += PGSIZE){
+    if((pte = walkpgdir(p->pgdir, (char*)a, 0)) == 0 || !(*pte & PTE_P))
+      continue;
+    if(v->f && (v->flags & MAP_SHARED) && (*pte & PTE_D))
+      writeback(v, a, P2V(PTE_ADDR(*pte)));
+    kfree(P2V(PTE_ADDR(*pte)));
+    *pte = 0;
+  }
+}
+
+// Map len bytes of f, from offset off, or anonymous memory if f is 0.
+// Returns the address of the mapping.
+int
+mmap(struct file *f, uint len, int prot, int flags, uint off)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+  uint va;
+
+  if(len == 0 || len > USERTOP || off % PGSIZE || (prot & ~(PROT_READ|PROT_WRITE)))
+    return -1;
+  if((flags & (MAP_SHARED|MAP_PRIVATE)) == 0 ||
+     (flags & (MAP_SHARED|MAP_PRIVATE)) == (MAP_SHARED|MAP_PRIVATE))
+    return -1;
+  if(f){
+    if(f->type != FD_INODE || f->ip->type != T_FILE || !f->readable)
+      return -1;
+    if((flags & MAP_SHARED) && (prot & PROT_WRITE) && !f->writable)
+      return -1;
+  }
+  len = PGROUNDUP(len);
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->len == 0)
+      break;
+  if(v == &p->vma[NVMA] || (va = vmaplace(p, len)) == 0)
+    return -1;
+  v->va = va;
+  v->len = len;
+  v->prot = prot;
+  v->flags = flags;
+  v->off = off;
+  v->f = f ? filedup(f) : 0;
+  return va;
+}
+
+// Unmap [va, va+len). It must be a whole mapping, or lie at the start
+// or end of one: a mapping is never split in two.
+int
+munmap(uint va, uint len)
+{
+  struct proc *p = myproc();
+  struct vma *v;
+
+  len = PGROUNDUP(len);
+  if(va % PGSIZE || len == 0 || (v = vmalookup(p, va)) == 0)
+    return -1;
+  if(va + len > v->va + v->len || (va != v->va && va + len != v->va + v->len))
+    return -1;
+  vmaunmap(p, v, va, len);
+  lcr3(V2P(p->pgdir));
+  if(va == v->va){
+    v->va += len;
+    v->off += len;
+  }
+  v->len -= len;
+  if(v->len == 0 && v->f){
+    fileclose(v->f);
+    v->f = 0;
+  }
+  return 0;
+}
+
+// Fill in a page of mapping v after a fault at va with error code err.
+int
+vmafault(struct proc *p, struct vma *v, uint va, uint err)
+{
+  pte_t *pte;
+  char *mem;
+
+  if((err & FEC_WR) && !(v->prot & PROT_WRITE))
+    return -1;
+  if(err & FEC_PR)
+    return (err & FEC_WR) ? cowfault(p->pgdir, va) : -1;
+  va = PGROUNDDOWN(va);
+  if((pte = walkpgdir(p->pgdir, (char*)va, 0)) != 0 && (*pte & PTE_P))
+    return 0;
+  if((mem = kzalloc()) == 0)
+    return -1;
+  if(v->f){
+    // whatever lies past the end of the file stays zero
+    ilock(v->f->ip);
+    readi(v->f->ip, mem, v->off + (va - v->va), PGSIZE);
+    iunlock(v->f->ip);
+  }
+  if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem),
+              PTE_U | ((v->prot & PROT_WRITE) ? PTE_W : 0)) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Give child np p's mappings on fork. On failure np is left with no
+// mappings, but possibly some of the pages; freevm() releases those.
+int
+vmacopy(struct proc *np, struct proc *p)
+{
+  struct vma *v;
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    v = &p->vma[i];
+    if(v->len == 0)
+      continue;
+    // A shared page the child faulted in for itself would be its own
+    // copy, so bring them all in now while both can still map them.
+    if((!(v->flags & MAP_PRIVATE) && uvmtouch(p, v->va, v->len, 0) < 0) ||
+       uvmshare(np->pgdir, p->pgdir, v->va, v->va + v->len, v->flags & MAP_PRIVATE) < 0){
+      lcr3(V2P(p->pgdir));
+      while(--i >= 0)
+        if(np->vma[i].f)
+          fileclose(np->vma[i].f);
+      memset(np->vma, 0, sizeof(np->vma));
+      return -1;
+    }
+    np->vma[i] = *v;
+    if(v->f)
+      filedup(v->f);
+  }
+  lcr3(V2P(p->pgdir));
+  return 0;
+}
+
+// Unmap everything: on exec and exit.
+void
+vmafree(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->len == 0)
+      continue;
+    vmaunmap(p, v, v->va, v->len);
+    if(v->f)
+      fileclose(v->f);
+    v->f = 0;
+    v->len = 0;
+  }
+  lcr3(V2P(p->pgdir));
+}
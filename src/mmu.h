@@ -38,6 +38,7 @@
 #define CR0_PG          0x80000000      // Paging
 
 #define CR4_PSE         0x00000010      // Page size extension
+#define CR4_PGE         0x00000080      // Page global enable
 
 // various segment selectors.
 #define SEG_KCODE 1  // kernel code
@@ -123,6 +124,7 @@ struct segdesc {
 #define NPDENTRIES      1024    // # directory entries per page directory
 #define NPTENTRIES      1024    // # PTEs per page table
 #define PGSIZE          4096    // bytes mapped by a page
+#define BIGPGSIZE       (NPTENTRIES*PGSIZE) // bytes mapped by a PTE_PS entry
 
 #define PGSHIFT         12      // log2(PGSIZE)
 #define PTXSHIFT        12      // offset of PTX in a linear address
@@ -140,15 +142,20 @@ struct segdesc {
 #define PTE_A           0x020   // Accessed
 #define PTE_D           0x040   // Dirty
 #define PTE_PS          0x080   // Page Size
+#define PTE_G           0x100   // Global: kept in the TLB across CR3 loads
 #define PTE_MBZ         0x180   // Bits must be zero
+#define PTE_COW         0x200   // Copy-on-write (available to software)
+
+// Page fault error code bits
+#define FEC_PR          0x1     // Protection violation (else not present)
+#define FEC_WR          0x2     // Caused by a write
+#define FEC_U           0x4     // Caused in user mode
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
 #define PTE_FLAGS(pte)  ((uint)(pte) &  0xFFF)
 
 #ifndef __ASSEMBLER__
-typedef uint pte_t;
-
 // Task state segment format
 struct taskstate {
   uint link;         // Old ts selector
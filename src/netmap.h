@@ -0,0 +1,37 @@
+#ifndef XV6_NETMAP_H
+#define XV6_NETMAP_H
+
+// User-space access to a NIC's packet buffers. netmap() maps, at
+// NETMAPVA, one page holding a struct nm_if followed by the NIC's
+// packet buffers; every slot gives its buffer's offset from NETMAPVA.
+//
+// In each ring user space owns the slots from head up to (not
+// including) tail. On RX those hold received frames: user space
+// consumes them and advances head. On TX they are free: user space
+// fills them, sets len and advances head. nmsync() then hands the
+// slots before head to the NIC and moves tail past the slots the
+// NIC is done with. The kernel's own traffic on the interface is
+// dropped while it is mapped.
+
+#define NM_SLOTS  128
+
+struct nm_slot {
+  uint off;         // buffer offset from NETMAPVA
+  ushort len;       // frame length
+  ushort flags;
+};
+
+struct nm_ring {
+  uint head;        // written by user space
+  uint tail;        // written by the kernel
+  uint nslots;
+  uint bufsize;     // bytes available in each buffer
+  struct nm_slot slot[NM_SLOTS];
+};
+
+struct nm_if {
+  struct nm_ring rx;
+  struct nm_ring tx;
+};
+
+#endif
@@ -1,23 +1,109 @@
 #include "nic.h"
 #include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+
+struct nic_device nic_devices[NNIC];
+
+// Protects rxgen and rxq of every device.
+static struct spinlock niclock;
+
+void nicinit(void) {
+  initlock(&niclock, "nic");
+}
 
 int get_device(char* interface, struct nic_device** nd) {
-  cprintf("get device for interface=%s\n", interface);
-  /**
-   *TODO: Use interface name to fetch device details
-   *from a table of loaded devices.
-   *
-   * For now, since we have only one device loaded at a time,
-   * this will suffice
-   */
-   if(nic_devices[0].send_packet == 0 || nic_devices[0].recv_packet == 0) {
-     return -1;
-   }
-   *nd = &nic_devices[0];
-
-   return 0;
+  for(int i = 0; i < NNIC; i++) {
+    if(nic_devices[i].send_packet == 0 || nic_devices[i].recv_packet == 0)
+      continue;
+    if(strncmp(nic_devices[i].name, interface, NIC_NAMELEN) == 0) {
+      *nd = &nic_devices[i];
+      return 0;
+    }
+  }
+  return -1;
 }
 
 void register_device(struct nic_device nd) {
-  nic_devices[0] = nd;
+  for(int i = 0; i < NNIC; i++) {
+    if(nic_devices[i].send_packet == 0) {
+      nic_devices[i] = nd;
+      cprintf("nic: registered interface %s\n", nd.name);
+      return;
+    }
+  }
+  panic("register_device: too many NICs");
+}
+
+// Called by a driver when frames may be waiting to be received:
+// wakes readers sleeping in nic_rxwait() and pollers of the device.
+void nic_rxready(void *driver) {
+  for(int i = 0; i < NNIC; i++) {
+    if(nic_devices[i].driver != driver || nic_devices[i].send_packet == 0)
+      continue;
+    acquire(&niclock);
+    nic_devices[i].rxgen++;
+    wakeup(&nic_devices[i].rxgen);
+    waitq_wake(&nic_devices[i].rxq);
+    release(&niclock);
+  }
+}
+
+// Sleep unless nic_rxready() was called for nd since rxgen was gen.
+void nic_rxwait(struct nic_device *nd, uint gen) {
+  acquire(&niclock);
+  if(nd->rxgen == gen)
+    sleep(&nd->rxgen, &niclock);
+  release(&niclock);
+}
+
+void nic_pollwait(struct nic_device *nd, struct pollent *pe) {
+  acquire(&niclock);
+  waitq_add(&nd->rxq, pe, &niclock);
+  release(&niclock);
+}
+
+// Map the packet buffers of nd into the current process at
+// NETMAPVA. Only one process at a time may own a NIC this way.
+int nic_netmap(struct nic_device *nd) {
+  struct proc *p = myproc();
+
+  if(p->netmap || nd->nm_attach == 0)
+    return -1;
+  if(nd->nm_attach(nd->driver, p->pgdir, NETMAPVA) < 0)
+    return -1;
+  p->netmap = nd;
+  return NETMAPVA;
+}
+
+// Give p's mapped NIC back to the kernel: on request, exec and exit.
+void netmapfree(struct proc *p) {
+  struct nic_device *nd = p->netmap;
+
+  if(nd == 0)
+    return;
+  p->netmap = 0;
+  nd->nm_detach(nd->driver, p->pgdir, NETMAPVA);
+  lcr3(V2P(p->pgdir));
+}
+
+// Sync the current process's rings with its NIC. If wait is set and
+// no received frame is waiting for user space, sleep for one first.
+int nic_nmsync(int wait) {
+  struct nic_device *nd = myproc()->netmap;
+  uint gen;
+  int n;
+
+  if(nd == 0)
+    return -1;
+  for(;;) {
+    gen = nd->rxgen;
+    if((n = nd->nm_sync(nd->driver)) != 0 || !wait || myproc()->killed)
+      return n;
+    nic_rxwait(nd, gen);
+  }
 }
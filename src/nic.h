@@ -8,20 +8,48 @@
 
 #include "types.h"
 #include "arp_frame.h"
+#include "poll.h"
+
+#define NNIC            2     // maximum number of loaded NIC devices
+#define NIC_NAMELEN     8     // interface name length, including the NUL
+#define NIC_FRAME_MAX   1518  // largest ethernet frame handed to/from a NIC
 
 //Generic NIC device driver container
 struct nic_device {
+  char name[NIC_NAMELEN];
   void *driver;
   uint8_t mac_addr[6];
   void (*send_packet) (void *driver, uint8_t* pkt, uint16_t length);
   void (*recv_packet) (void *driver, uint8_t* pkt, uint16_t *length);
+  int (*ctl) (void *driver, int op, int arg, uint8_t *addr);  //optional, see NIC_CTL_*
+  //optional: map the packet buffers into user space, see netmap.h
+  int (*nm_attach) (void *driver, pde_t *pgdir, uint va);
+  void (*nm_detach) (void *driver, pde_t *pgdir, uint va);
+  int (*nm_sync) (void *driver);  //returns RX slots owned by user space
+  uint rxgen;                 //bumped by nic_rxready(), see nic_rxwait()
+  struct waitq rxq;           //pollers waiting for received frames
 };
 
+// nicctl() operations
+#define NIC_CTL_VLAN      1   // arg!=0: strip 802.1Q tags and filter by VLAN id
+#define NIC_CTL_VLAN_ADD  2   // accept frames tagged with VLAN id arg
+#define NIC_CTL_VLAN_DEL  3   // stop accepting VLAN id arg
+#define NIC_CTL_VLAN_TAG  4   // tag sent frames with TCI arg, in VLAN mode (0: untagged)
+#define NIC_CTL_PROMISC   5   // arg!=0: accept all unicast and multicast frames
+#define NIC_CTL_RAR_SET   6   // receive address slot arg accepts addr (0: clear it)
+#define NIC_CTL_MCAST_ADD 7   // accept frames sent to multicast group addr
+#define NIC_CTL_MCAST_DEL 8   // leave multicast group addr
+
 //Holds the instances of nic_devices for loaded devices
-//Lets say for now there can't be more than 1 loaded NIC device
-struct nic_device nic_devices[1];
+extern struct nic_device nic_devices[NNIC];
 
 void register_device(struct nic_device nd);
 int get_device(char* interface, struct nic_device** nd);
+void nicinit(void);
+void nic_rxready(void *driver);
+void nic_rxwait(struct nic_device *nd, uint gen);
+void nic_pollwait(struct nic_device *nd, struct pollent *pe);
+int nic_netmap(struct nic_device *nd);
+int nic_nmsync(int wait);
 
 #endif
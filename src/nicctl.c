@@ -0,0 +1,107 @@
+#include "types.h"
+#include "user.h"
+#include "nic.h"
+
+#define NOARG    0
+#define INTARG   1   // integer argument from the command line
+#define MACARG   2   // hardware address argument
+#define SLOTMAC  3   // integer slot, then a hardware address or "none"
+
+static struct {
+  char *name;
+  int op;
+  int args;      // which arguments come from the command line
+  int arg;       // integer argument when args is NOARG or MACARG
+  char *help;
+} cmds[] = {
+  { "vlan-on",    NIC_CTL_VLAN,      NOARG,   1, "strip 802.1Q tags, filter by VLAN id" },
+  { "vlan-off",   NIC_CTL_VLAN,      NOARG,   0, "stop VLAN stripping, filtering and tagging" },
+  { "vlan-add",   NIC_CTL_VLAN_ADD,  INTARG,  0, "<vid>: accept VLAN id" },
+  { "vlan-del",   NIC_CTL_VLAN_DEL,  INTARG,  0, "<vid>: stop accepting VLAN id" },
+  { "vlan-tag",   NIC_CTL_VLAN_TAG,  INTARG,  0, "<tci>: tag sent frames after vlan-on, 0 for none" },
+  { "promisc-on", NIC_CTL_PROMISC,   NOARG,   1, "accept every frame" },
+  { "promisc-off",NIC_CTL_PROMISC,   NOARG,   0, "accept only our addresses and groups" },
+  { "rar",        NIC_CTL_RAR_SET,   SLOTMAC, 0, "<slot> <mac|none>: set a receive address" },
+  { "mcast-add",  NIC_CTL_MCAST_ADD, MACARG,  0, "<mac>: join a multicast group" },
+  { "mcast-del",  NIC_CTL_MCAST_DEL, MACARG,  0, "<mac>: leave a multicast group" },
+};
+
+static void
+usage(void)
+{
+  int i;
+
+  printf(2, "usage: nicctl interface command [args]\n");
+  for(i = 0; i < sizeof(cmds)/sizeof(cmds[0]); i++)
+    printf(2, "  %s\t%s\n", cmds[i].name, cmds[i].help);
+  exit();
+}
+
+static int
+hexval(char c)
+{
+  if(c >= '0' && c <= '9')
+    return c - '0';
+  if(c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if(c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+// Parse "xx:xx:xx:xx:xx:xx". Returns 0 on success.
+static int
+parsemac(char *s, uchar *mac)
+{
+  int i, hi, lo;
+
+  for(i = 0; i < 6; i++){
+    if((hi = hexval(s[0])) < 0 || (lo = hexval(s[1])) < 0)
+      return -1;
+    mac[i] = hi << 4 | lo;
+    s += 2;
+    if(*s != (i < 5 ? ':' : 0))
+      return -1;
+    s++;
+  }
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, arg, need;
+  uchar mac[6], *addr;
+
+  if(argc < 3)
+    usage();
+  for(i = 0; i < sizeof(cmds)/sizeof(cmds[0]); i++)
+    if(strcmp(argv[2], cmds[i].name) == 0)
+      break;
+  if(i == sizeof(cmds)/sizeof(cmds[0]))
+    usage();
+
+  need = cmds[i].args == NOARG ? 3 : cmds[i].args == SLOTMAC ? 5 : 4;
+  if(argc < need)
+    usage();
+
+  arg = cmds[i].arg;
+  addr = 0;
+  if(cmds[i].args == INTARG || cmds[i].args == SLOTMAC)
+    arg = atoi(argv[3]);
+  if(cmds[i].args == MACARG || cmds[i].args == SLOTMAC){
+    if(cmds[i].args == SLOTMAC && strcmp(argv[4], "none") == 0)
+      addr = 0;
+    else if(parsemac(argv[need-1], mac) < 0){
+      printf(2, "nicctl: bad hardware address %s\n", argv[need-1]);
+      exit();
+    } else
+      addr = mac;
+  }
+
+  if(nicctl(argv[1], cmds[i].op, arg, addr) < 0){
+    printf(2, "nicctl: %s %s failed\n", argv[1], argv[2]);
+    exit();
+  }
+  exit();
+}
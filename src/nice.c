@@ -0,0 +1,37 @@
+// Run a command with another scheduling priority: a nice value for
+// the time-shared class, or with -r a real-time priority, which runs
+// ahead of every time-shared process (e.g. for a network daemon).
+//
+// usage: nice [-r] prio command [arg...]
+
+#include "types.h"
+#include "user.h"
+#include "sched.h"
+
+int
+main(int argc, char *argv[])
+{
+  int class, prio, i;
+
+  class = SCHED_FAIR;
+  i = 1;
+  if(argc > 1 && strcmp(argv[1], "-r") == 0){
+    class = SCHED_RT;
+    i++;
+  }
+  if(argc < i + 2){
+    printf(2, "usage: nice [-r] prio command [arg...]\n");
+    exit();
+  }
+  if(argv[i][0] == '-')
+    prio = -atoi(argv[i] + 1);
+  else
+    prio = atoi(argv[i]);
+  if(setpriority(0, class, prio) < 0){
+    printf(2, "nice: bad priority %s\n", argv[i]);
+    exit();
+  }
+  exec(argv[i+1], argv + i + 1);
+  printf(2, "nice: exec %s failed\n", argv[i+1]);
+  exit();
+}
@@ -0,0 +1,58 @@
+// Send every frame received on an interface straight back to its
+// sender, working on the NIC's rings through netmap() with one
+// nmsync() per batch instead of system calls per frame.
+//
+// usage: nmreflect [count [interface]]
+
+#include "types.h"
+#include "user.h"
+#include "netmap.h"
+
+#define NEXT(r, i)  (((i) + 1) % (r)->nslots)
+
+int
+main(int argc, char *argv[])
+{
+  char *iface = "mynet0", *base, *rx, *tx;
+  struct nm_if *nm;
+  struct nm_ring *rr, *tr;
+  int count = 100, done = 0, syncs = 0, len, i;
+
+  if(argc > 1)
+    count = atoi(argv[1]);
+  if(argc > 2)
+    iface = argv[2];
+  if((int)(nm = netmap(iface, 1)) == -1){
+    printf(2, "nmreflect: cannot map %s\n", iface);
+    exit();
+  }
+  base = (char*)nm;
+  rr = &nm->rx;
+  tr = &nm->tx;
+
+  while(done < count){
+    if(nmsync(1) < 0)
+      break;
+    syncs++;
+    while(rr->head != rr->tail && tr->head != tr->tail && done < count){
+      rx = base + rr->slot[rr->head].off;
+      tx = base + tr->slot[tr->head].off;
+      len = rr->slot[rr->head].len;
+      if(len > tr->bufsize)
+        len = tr->bufsize;
+      // destination <- source, source <- destination
+      memmove(tx, rx + 6, 6);
+      memmove(tx + 6, rx, 6);
+      for(i = 12; i < len; i++)
+        tx[i] = rx[i];
+      tr->slot[tr->head].len = len;
+      tr->head = NEXT(tr, tr->head);
+      rr->head = NEXT(rr, rr->head);
+      done++;
+    }
+  }
+  nmsync(0);
+  netmap(iface, 0);
+  printf(1, "nmreflect: %d frames in %d syncs\n", done, syncs);
+  exit();
+}
@@ -1,7 +1,10 @@
 #define NPROC        64  // maximum number of processes
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
+#define TICKNS   10000000  // clock tick for sleep() and uptime(), and time slice (ns)
 #define NOFILE       16  // open files per process
+#define NSEG          4  // demand-loaded program segments per process
+#define NVMA          8  // mmap() mappings per process
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
@@ -22,11 +22,18 @@ static int e1000_attach(struct pci_func *pcif) {
 	pci_func_enable(pcif);
 	struct nic_device nd;
 
+	memset(&nd, 0, sizeof(nd));
+	safestrcpy(nd.name, "mynet0", sizeof(nd.name));
 	fillbuf(nd.mac_addr,0,0x563412005452l,6);
 
-	e1000_init(pcif, &nd.driver, nd.mac_addr);
+	if(e1000_init(pcif, &nd.driver, nd.mac_addr) < 0)
+		return -1;
 	nd.send_packet = e1000_send;
 	nd.recv_packet = e1000_recv;
+	nd.ctl = e1000_ctl;
+	nd.nm_attach = e1000_nm_attach;
+	nd.nm_detach = e1000_nm_detach;
+	nd.nm_sync = e1000_nm_sync;
 	register_device(nd);
   return 0;
 }
@@ -7,6 +7,7 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "poll.h"
 
 #define PIPESIZE 512
 
@@ -17,8 +18,17 @@ struct pipe {
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  struct waitq waitq;  // pollers of either end
 };
 
+static struct slabcache *pipecache;
+
+void
+pipeinit(void)
+{
+  pipecache = slabcreate("pipe", sizeof(struct pipe));
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,12 +38,13 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((p = (struct pipe*)kalloc()) == 0)
+  if((p = (struct pipe*)slaballoc(pipecache)) == 0)
     goto bad;
   p->readopen = 1;
   p->writeopen = 1;
   p->nwrite = 0;
   p->nread = 0;
+  p->waitq.head = 0;
   initlock(&p->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -48,7 +59,7 @@ pipealloc(struct file **f0, struct file **f1)
 //PAGEBREAK: 20
  bad:
   if(p)
-    kfree((char*)p);
+    slabfree(pipecache, p);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -67,9 +78,10 @@ pipeclose(struct pipe *p, int writable)
     p->readopen = 0;
     wakeup(&p->nwrite);
   }
+  waitq_wake(&p->waitq);
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
-    kfree((char*)p);
+    slabfree(pipecache, p);
   } else
     release(&p->lock);
 }
@@ -88,11 +100,13 @@ pipewrite(struct pipe *p, char *addr, int n)
         return -1;
       }
       wakeup(&p->nread);
+      waitq_wake(&p->waitq);
       sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
     }
     p->data[p->nwrite++ % PIPESIZE] = addr[i];
   }
   wakeup(&p->nread);  //DOC: pipewrite-wakeup1
+  waitq_wake(&p->waitq);
   release(&p->lock);
   return n;
 }
@@ -116,6 +130,31 @@ piperead(struct pipe *p, char *addr, int n)
     addr[i] = p->data[p->nread++ % PIPESIZE];
   }
   wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  waitq_wake(&p->waitq);
   release(&p->lock);
   return i;
 }
+
+// Readiness of the writable or the read end of p for poll().
+int
+pipepoll(struct pipe *p, int writable, struct pollent *pe)
+{
+  int r = 0;
+
+  acquire(&p->lock);
+  if(pe)
+    waitq_add(&p->waitq, pe, &p->lock);
+  if(writable){
+    if(p->nwrite != p->nread + PIPESIZE)
+      r |= POLLOUT;
+    if(p->readopen == 0)
+      r |= POLLERR;
+  } else {
+    if(p->nread != p->nwrite)
+      r |= POLLIN;
+    if(p->writeopen == 0)
+      r |= POLLHUP;
+  }
+  release(&p->lock);
+  return r;
+}
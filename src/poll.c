@@ -0,0 +1,143 @@
+// poll(): wait until any of several files is ready.
+//
+// Every pollable object (pipe, console, NIC) keeps a wait queue
+// protected by its own lock. A poller links an entry into the queue
+// of each file it waits on, rescans all files whenever one of them
+// wakes it, and unlinks the entries before returning.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "mmu.h"
+#include "proc.h"
+#include "poll.h"
+#include "timer.h"
+
+// polllock orders wakeups against pollers going to sleep: the
+// woken flags are only written and tested while it is held.
+static struct spinlock polllock;
+
+void
+pollinit(void)
+{
+  initlock(&polllock, "poll");
+}
+
+// Link pe into q. Caller holds lk, the lock protecting q.
+void
+waitq_add(struct waitq *q, struct pollent *pe, struct spinlock *lk)
+{
+  pe->q = q;
+  pe->lock = lk;
+  pe->next = q->head;
+  q->head = pe;
+}
+
+static void
+wakeall(struct waitq *q)
+{
+  struct pollent *pe;
+
+  for(pe = q->head; pe; pe = pe->next){
+    *pe->woken = 1;
+    wakeup(pe->woken);
+  }
+}
+
+// Wake every poller on q. Caller holds the lock protecting q.
+void
+waitq_wake(struct waitq *q)
+{
+  if(q->head == 0)
+    return;
+  acquire(&polllock);
+  wakeall(q);
+  release(&polllock);
+}
+
+// A timed poller's deadline passed.
+static void
+polltimeout(void *woken)
+{
+  acquire(&polllock);
+  *(int*)woken = 1;
+  wakeup(woken);
+  release(&polllock);
+}
+
+static void
+pollent_del(struct pollent *pe)
+{
+  struct pollent **pp;
+
+  acquire(pe->lock);
+  for(pp = &pe->q->head; *pp; pp = &(*pp)->next){
+    if(*pp == pe){
+      *pp = pe->next;
+      break;
+    }
+  }
+  pe->q = 0;
+  release(pe->lock);
+}
+
+// Wait until one of the n files is ready for the events asked for
+// in fds, or for timeout milliseconds (forever if timeout < 0).
+// files[i] is the open file behind fds[i], or 0.
+// Returns the number of fds with events, or -1 if killed.
+int
+poll(struct file **files, struct pollfd *fds, int n, int timeout)
+{
+  struct pollent ent[NOFILE];
+  struct timer tm = TIMER_INIT;
+  uint64_t deadline = 0;
+  int i, r, ready, first, woken;
+
+  memset(ent, 0, sizeof(ent));
+  for(i = 0; i < n; i++)
+    ent[i].woken = &woken;
+  if(timeout > 0){
+    deadline = nsecs() + (uint64_t)timeout * 1000000;
+    timeradd(&tm, deadline, polltimeout, &woken);
+  }
+
+  for(first = 1; ; first = 0){
+    acquire(&polllock);
+    woken = 0;
+    release(&polllock);
+
+    // The first pass also queues an entry on every object; an object
+    // that changes after being looked at then sets woken.
+    ready = 0;
+    for(i = 0; i < n; i++){
+      if(fds[i].fd < 0)
+        r = 0;
+      else if(files[i] == 0)
+        r = POLLNVAL;
+      else
+        r = filepoll(files[i], first ? &ent[i] : 0);
+      fds[i].revents = r & (fds[i].events | POLLERR | POLLHUP | POLLNVAL);
+      if(fds[i].revents)
+        ready++;
+    }
+    if(ready || timeout == 0 || myproc()->killed)
+      break;
+    if(timeout > 0 && nsecs() >= deadline)
+      break;
+
+    acquire(&polllock);
+    if(!woken)
+      sleep(&woken, &polllock);
+    release(&polllock);
+  }
+
+  for(i = 0; i < n; i++)
+    if(ent[i].q)
+      pollent_del(&ent[i]);
+  if(timeout > 0)
+    timerdel(&tm);
+  if(myproc()->killed)
+    return -1;
+  return ready;
+}
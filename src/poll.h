@@ -0,0 +1,31 @@
+#ifndef XV6_POLL_H
+#define XV6_POLL_H
+
+// poll() events
+#define POLLIN    0x001   // data can be read without blocking
+#define POLLOUT   0x004   // data can be written without blocking
+#define POLLERR   0x008   // error condition (always reported)
+#define POLLHUP   0x010   // peer closed (always reported)
+#define POLLNVAL  0x020   // fd is not open (always reported)
+
+struct pollfd {
+  int fd;
+  short events;     // requested events
+  short revents;    // returned events
+};
+
+// A process blocked in poll() links one pollent per file into the
+// wait queue of the object behind it. Waking a queue marks every
+// poller on it woken; the poller then rescans all of its files.
+struct pollent {
+  int *woken;               // poller's flag, also its sleep channel
+  struct waitq *q;          // queue this entry is on, 0 if none
+  struct spinlock *lock;    // lock protecting q
+  struct pollent *next;
+};
+
+struct waitq {
+  struct pollent *head;
+};
+
+#endif
@@ -4,26 +4,88 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "x86.h"
+#include "traps.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "sched.h"
 
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
 } ptable;
 
+// Per-CPU run queues of RUNNABLE processes. SCHED_RT processes are
+// kept in a FIFO per priority and run first, highest priority first;
+// SCHED_FAIR processes are kept in order of vruntime, the time they
+// have run scaled down by their weight, and the least run goes next.
+// A CPU's scheduler holds its queue's lock across swtch, the way xv6
+// holds ptable.lock, and the process it switches to releases it. So a
+// process that is queued has finished switching out, and the lock is
+// held whenever the CPU's %cr3 may hold the page table of a process
+// not running on it. Lock order: ptable.lock, a sleepq lock, then one
+// runq lock.
+struct runq {
+  struct spinlock lock;
+  struct proc *rt[NRTPRIO];    // SCHED_RT FIFOs
+  struct proc *rttail[NRTPRIO];
+  uint rtmask;                 // bit i set if rt[i] is not empty
+  struct proc *fair;           // SCHED_FAIR, by vruntime
+  uint64_t minvruntime;        // vruntime of the last one picked
+  int n;                       // processes queued
+  uint steals;                 // processes taken from other queues
+};
+
+static struct runq runq[NCPU];
+
+// Sleeping processes, hashed by channel, so that wakeup() looks only
+// at processes that may be sleeping on its channel. A bucket's lock
+// protects the state of the processes sleeping in it.
+#define SLEEPQBITS  6
+#define NSLEEPQ     (1 << SLEEPQBITS)
+#define SLEEPQ(chan) (&sleepq[((uint)(chan) * 2654435761U) >> (32 - SLEEPQBITS)])
+
+struct sleepq {
+  struct spinlock lock;
+  struct proc *head;
+};
+
+static struct sleepq sleepq[NSLEEPQ];
+
+// SCHED_FAIR weights by nice value, each step about 10% of the CPU
+// against a process one step away; nice 0 weighs NICE0_WEIGHT.
+#define NICE0_WEIGHT  1024
+static const uint niceweight[NICE_MAX - NICE_MIN + 1] = {
+  88761, 71755, 56483, 46273, 36291,
+  29154, 23254, 18705, 14949, 11916,
+   9548,  7620,  6100,  4904,  3906,
+   3121,  2501,  1991,  1586,  1277,
+   1024,   820,   655,   526,   423,
+    335,   272,   215,   172,   137,
+    110,    87,    70,    56,    45,
+     36,    29,    23,    18,    15,
+};
+// 2^32 / niceweight[i], so charge() need not divide 64-bit numbers.
+static uint niceinv[NICE_MAX - NICE_MIN + 1];
+
 static struct proc *initproc;
 
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
 
-static void wakeup1(void *chan);
 
 void
 pinit(void)
 {
+  int i;
+
   initlock(&ptable.lock, "ptable");
+  for(i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
+  for(i = 0; i < NSLEEPQ; i++)
+    initlock(&sleepq[i].lock, "sleepq");
+  for(i = 0; i < NELEM(niceweight); i++)
+    niceinv[i] = 0xFFFFFFFF / niceweight[i];
 }
 
 // Must be called with interrupts disabled
@@ -65,6 +127,236 @@ myproc(void) {
   return p;
 }
 
+// May p run on CPU id?
+static int
+allowed(struct proc *p, int id)
+{
+  return p->affinity == 0 || (p->affinity & (1 << id));
+}
+
+// Append p to rq. Caller holds rq->lock.
+static void
+rqpush(struct runq *rq, struct proc *p)
+{
+  struct proc **pp;
+
+  p->rqnext = 0;
+  if(p->class == SCHED_RT){
+    if(rq->rttail[p->rtprio])
+      rq->rttail[p->rtprio]->rqnext = p;
+    else
+      rq->rt[p->rtprio] = p;
+    rq->rttail[p->rtprio] = p;
+    rq->rtmask |= 1 << p->rtprio;
+  } else {
+    // A process that slept or came from another CPU does not get
+    // to catch up on the time it was away.
+    if(p->vruntime < rq->minvruntime)
+      p->vruntime = rq->minvruntime;
+    for(pp = &rq->fair; *pp && (*pp)->vruntime <= p->vruntime;
+        pp = &(*pp)->rqnext)
+      ;
+    p->rqnext = *pp;
+    *pp = p;
+  }
+  rq->n++;
+}
+
+// Unlink and return the first process on list *head that may run
+// on CPU id (any, if id is -1) or that is p (if p is not 0), keeping
+// *tail, if given, at the last process.
+static struct proc*
+rqunlink(struct proc **head, struct proc **tail, int id, struct proc *p)
+{
+  struct proc *q, *prev, **pp;
+
+  prev = 0;
+  for(pp = head; (q = *pp) != 0; pp = &q->rqnext){
+    if(p ? q == p : (id < 0 || allowed(q, id))){
+      *pp = q->rqnext;
+      if(tail && *tail == q)
+        *tail = prev;
+      return q;
+    }
+    prev = q;
+  }
+  return 0;
+}
+
+// Remove and return the first process on rq that may run on CPU id,
+// or 0. On a CPU's own queue that is always the head of the highest
+// non-empty list. Caller holds rq->lock.
+static struct proc*
+rqpop(struct runq *rq, int id)
+{
+  struct proc *p;
+  int i;
+
+  for(i = NRTPRIO - 1; i >= 0; i--){
+    if((rq->rtmask & (1 << i)) == 0)
+      continue;
+    if((p = rqunlink(&rq->rt[i], &rq->rttail[i], id, 0)) != 0){
+      if(rq->rt[i] == 0)
+        rq->rtmask &= ~(1 << i);
+      rq->n--;
+      return p;
+    }
+  }
+  if((p = rqunlink(&rq->fair, 0, id, 0)) != 0){
+    if(p->vruntime > rq->minvruntime)
+      rq->minvruntime = p->vruntime;
+    rq->n--;
+  }
+  return p;
+}
+
+// Take p off rq, if it is there. Caller holds rq->lock.
+static int
+rqremove(struct runq *rq, struct proc *p)
+{
+  struct proc *q;
+
+  if(p->class == SCHED_RT){
+    q = rqunlink(&rq->rt[p->rtprio], &rq->rttail[p->rtprio], -1, p);
+    if(rq->rt[p->rtprio] == 0)
+      rq->rtmask &= ~(1 << p->rtprio);
+  } else
+    q = rqunlink(&rq->fair, 0, -1, p);
+  if(q)
+    rq->n--;
+  return q != 0;
+}
+
+// Should p run before q?
+static int
+outranks(struct proc *p, struct proc *q)
+{
+  if(p->class != q->class)
+    return p->class == SCHED_RT;
+  return p->class == SCHED_RT && p->rtprio > q->rtprio;
+}
+
+// Charge p for the time since scheduler() switched to it.
+static void
+charge(struct proc *p)
+{
+  uint ns;
+
+  ns = (uint)(nsecs() - p->runstart);
+  if(p->class == SCHED_FAIR)
+    p->vruntime += ((uint64_t)ns * niceinv[p->nice - NICE_MIN]) >> 22;
+}
+
+// Interrupt CPU id so that it looks at its run queue again.
+// Caller has interrupts off.
+static void
+kick(int id)
+{
+  if(id != cpuid())
+    lapicipi(cpus[id].apicid, T_IRQ0 + IRQ_RESCHED);
+}
+
+// Queue runnable p on CPU id, and have the CPU switch to it soon if
+// it is halted or p outranks what is running there. If the CPU is
+// busy, wake a halted CPU that could steal p instead.
+static void
+enqueue(struct proc *p, int id)
+{
+  struct runq *rq = &runq[id];
+  struct cpu *c = &cpus[id];
+  int i, resched;
+
+  acquire(&rq->lock);
+  p->cpu = id;
+  p->state = RUNNABLE;
+  rqpush(rq, p);
+  if(c->proc && outranks(p, c->proc))
+    c->resched = 1;
+  resched = c->resched;
+  release(&rq->lock);
+
+  // release() is a full barrier, so an idle CPU either sees p on
+  // its queue before it halts or has set idle for us to see here.
+  pushcli();
+  if(c->idle || resched)
+    kick(id);
+  else if(c->proc){
+    for(i = 0; i < ncpu; i++)
+      if(cpus[i].idle && allowed(p, i)){
+        kick(i);
+        break;
+      }
+  }
+  popcli();
+}
+
+// Choose a CPU for p that is allowed to run it: the one it last ran
+// on, or if spread is set, the one with the shortest queue.
+static int
+placecpu(struct proc *p, int spread)
+{
+  int i, id;
+
+  id = -1;
+  if(allowed(p, p->cpu) && p->cpu < ncpu){
+    if(!spread)
+      return p->cpu;
+    id = p->cpu;
+  }
+  for(i = 0; i < ncpu; i++)
+    if(allowed(p, i) && (id < 0 || runq[i].n < runq[id].n))
+      id = i;
+  if(id < 0)
+    panic("placecpu");
+  return id;
+}
+
+// Lock the current CPU's run queue, to switch away from a process.
+static void
+lockrq(void)
+{
+  pushcli();
+  acquire(&runq[cpuid()].lock);
+  popcli();
+}
+
+// Release the current CPU's run queue, after switching to a process.
+static void
+unlockrq(void)
+{
+  release(&runq[cpuid()].lock);
+}
+
+// Move a process that may run on CPU id from the longest other queue
+// to id's. Return 0 if there was none.
+static int
+steal(int id)
+{
+  struct runq *rq;
+  struct proc *p;
+  int i, v;
+
+  v = -1;
+  for(i = 0; i < ncpu; i++)
+    if(i != id && runq[i].n > 0 && (v < 0 || runq[i].n > runq[v].n))
+      v = i;
+  if(v < 0)
+    return 0;
+  rq = &runq[v];
+  acquire(&rq->lock);
+  p = rqpop(rq, id);
+  release(&rq->lock);
+  if(p == 0)
+    return 0;
+  rq = &runq[id];
+  acquire(&rq->lock);
+  p->cpu = id;
+  rqpush(rq, p);
+  rq->steals++;
+  release(&rq->lock);
+  return 1;
+}
+
 //PAGEBREAK: 32
 // Look in the process table for an UNUSED proc.
 // If found, change state to EMBRYO and initialize
@@ -88,6 +380,17 @@ allocproc(void)
 found:
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->uring = 0;
+  p->netmap = 0;
+  p->exe = 0;
+  p->nseg = 0;
+  memset(p->vma, 0, sizeof(p->vma));
+  p->cpu = 0;
+  p->affinity = 0;
+  p->class = SCHED_FAIR;
+  p->nice = 0;
+  p->rtprio = 0;
+  p->vruntime = 0;
 
   release(&ptable.lock);
 
@@ -142,15 +445,9 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  // this assignment to p->state lets other cores
-  // run this process. the acquire forces the above
-  // writes to be visible, and the lock is also needed
-  // because the assignment might not be atomic.
-  acquire(&ptable.lock);
-
-  p->state = RUNNABLE;
-
-  release(&ptable.lock);
+  // queueing p lets other cores run this process. the acquire
+  // forces the above writes to be visible.
+  enqueue(p, 0);
 }
 
 // Grow current process's memory by n bytes.
@@ -163,8 +460,14 @@ growproc(int n)
 
   sz = curproc->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    // Pages are allocated when first touched (see lazyfault), but
+    // refuse to promise more than is free now, so that running out
+    // of memory still shows up as a failed sbrk() and not a fault.
+    if(sz + n > vmabase(curproc) || sz + n < sz)
+      return -1;
+    if((PGROUNDUP(sz + n) - PGROUNDUP(sz)) / PGSIZE > kfreecount())
       return -1;
+    sz += n;
   } else if(n < 0){
     if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
@@ -196,6 +499,13 @@ fork(void)
     np->state = UNUSED;
     return -1;
   }
+  if(vmacopy(np, curproc) < 0){
+    freevm(np->pgdir);
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
   np->sz = curproc->sz;
   np->parent = curproc;
   *np->tf = *curproc->tf;
@@ -207,16 +517,24 @@ fork(void)
     if(curproc->ofile[i])
       np->ofile[i] = filedup(curproc->ofile[i]);
   np->cwd = idup(curproc->cwd);
+  // Pages the parent never touched are loaded by the child itself.
+  if(curproc->exe)
+    np->exe = idup(curproc->exe);
+  np->nseg = curproc->nseg;
+  memmove(np->seg, curproc->seg, sizeof(np->seg));
 
   safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
   pid = np->pid;
 
-  acquire(&ptable.lock);
-
-  np->state = RUNNABLE;
-
-  release(&ptable.lock);
+  // Start the child on the least busy CPU it may use.
+  np->affinity = curproc->affinity;
+  np->class = curproc->class;
+  np->nice = curproc->nice;
+  np->rtprio = curproc->rtprio;
+  np->vruntime = curproc->vruntime;
+  np->cpu = curproc->cpu;
+  enqueue(np, placecpu(np, 1));
 
   return pid;
 }
@@ -241,28 +559,36 @@ exit(void)
       curproc->ofile[fd] = 0;
     }
   }
+  uringfree(curproc);
+  netmapfree(curproc);
+  vmafree(curproc);
 
   begin_op();
   iput(curproc->cwd);
+  if(curproc->exe)
+    iput(curproc->exe);
   end_op();
   curproc->cwd = 0;
+  curproc->exe = 0;
 
   acquire(&ptable.lock);
 
   // Parent might be sleeping in wait().
-  wakeup1(curproc->parent);
+  wakeup(curproc->parent);
 
   // Pass abandoned children to init.
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->parent == curproc){
       p->parent = initproc;
       if(p->state == ZOMBIE)
-        wakeup1(initproc);
+        wakeup(initproc);
     }
   }
 
   // Jump into the scheduler, never to return.
   curproc->state = ZOMBIE;
+  lockrq();
+  release(&ptable.lock);
   sched();
   panic("zombie exit");
 }
@@ -285,7 +611,10 @@ wait(void)
         continue;
       havekids = 1;
       if(p->state == ZOMBIE){
-        // Found one.
+        // Found one. Its CPU may still be switching away from it;
+        // that is done once the CPU's run queue lock is free.
+        acquire(&runq[p->cpu].lock);
+        release(&runq[p->cpu].lock);
         pid = p->pid;
         kfree(p->kstack);
         p->kstack = 0;
@@ -306,7 +635,7 @@ wait(void)
       return -1;
     }
 
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
+    // Wait for children to exit.  (See wakeup call in proc_exit.)
     sleep(curproc, &ptable.lock);  //DOC: wait-sleep
   }
 }
@@ -324,38 +653,72 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  struct runq *rq;
+  int id;
+
   c->proc = 0;
-  
+  id = c - cpus;
+  rq = &runq[id];
+
   for(;;){
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
+    // Nothing queued here: take work from another CPU, or else do
+    // background work for the page allocator, or else halt until an
+    // interrupt, such as the IPI enqueue() sends when it queues work.
+    if(rq->n == 0 && !steal(id)){
+      if(kzeroidle())
         continue;
+      cli();
+      timerslice(0);
+      xchg(&c->idle, 1);
+      if(rq->n == 0)
+        stihlt();
+      c->idle = 0;
+      continue;
+    }
 
+    acquire(&rq->lock);
+    while((p = rqpop(rq, id)) != 0){
       // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
+      // to release rq->lock and then reacquire it
       // before jumping back to us.
+      timerslice(1);
       c->proc = p;
+      c->resched = 0;
+      p->cpu = id;
       switchuvm(p);
       p->state = RUNNING;
+      p->runstart = nsecs();
 
       swtch(&(c->scheduler), p->context);
-      switchkvm();
+      charge(p);
 
       // Process is done running for now.
       // It should have changed its p->state before coming back.
+      // Its page table stays loaded: the kernel part is the same in
+      // every page table, so there is no need for switchkvm until
+      // rq->lock is released and p could exit or exec elsewhere.
       c->proc = 0;
+      if(p->state == RUNNABLE){
+        if(allowed(p, id)){
+          rqpush(rq, p);
+        } else {
+          // Its affinity changed: move it to a CPU it may use.
+          switchkvm();
+          release(&rq->lock);
+          enqueue(p, placecpu(p, 0));
+          acquire(&rq->lock);
+        }
+      }
     }
-    release(&ptable.lock);
-
+    switchkvm();
+    release(&rq->lock);
   }
 }
 
-// Enter scheduler.  Must hold only ptable.lock
+// Enter scheduler.  Must hold only this CPU's run queue lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
@@ -368,8 +731,8 @@ sched(void)
   int intena;
   struct proc *p = myproc();
 
-  if(!holding(&ptable.lock))
-    panic("sched ptable.lock");
+  if(!holding(&runq[cpuid()].lock))
+    panic("sched runq lock");
   if(mycpu()->ncli != 1)
     panic("sched locks");
   if(p->state == RUNNING)
@@ -385,10 +748,10 @@ sched(void)
 void
 yield(void)
 {
-  acquire(&ptable.lock);  //DOC: yieldlock
+  lockrq();  //DOC: yieldlock
   myproc()->state = RUNNABLE;
   sched();
-  release(&ptable.lock);
+  unlockrq();
 }
 
 // A fork child's very first scheduling by scheduler()
@@ -397,8 +760,8 @@ void
 forkret(void)
 {
   static int first = 1;
-  // Still holding ptable.lock from scheduler.
-  release(&ptable.lock);
+  // Still holding the run queue lock from scheduler.
+  unlockrq();
 
   if (first) {
     // Some initialization functions must be run in the context
@@ -418,6 +781,7 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct sleepq *sq = SLEEPQ(chan);
   
   if(p == 0)
     panic("sleep");
@@ -425,52 +789,60 @@ sleep(void *chan, struct spinlock *lk)
   if(lk == 0)
     panic("sleep without lk");
 
-  // Must acquire ptable.lock in order to
-  // change p->state and then call sched.
-  // Once we hold ptable.lock, we can be
+  // Must acquire chan's wait queue lock in order to
+  // change p->state.
+  // Once we hold it, we can be
   // guaranteed that we won't miss any wakeup
-  // (wakeup runs with ptable.lock locked),
+  // (wakeup runs with it locked),
   // so it's okay to release lk.
-  if(lk != &ptable.lock){  //DOC: sleeplock0
-    acquire(&ptable.lock);  //DOC: sleeplock1
-    release(lk);
-  }
-  // Go to sleep.
+  acquire(&sq->lock);  //DOC: sleeplock1
+  release(lk);
+  // Go to sleep. A wakeup from here on queues p on this CPU, which
+  // waits for the run queue lock until p has switched out.
   p->chan = chan;
   p->state = SLEEPING;
+  p->sqnext = sq->head;
+  sq->head = p;
+  lockrq();
+  release(&sq->lock);
 
   sched();
 
   // Tidy up.
   p->chan = 0;
+  unlockrq();
 
   // Reacquire original lock.
-  if(lk != &ptable.lock){  //DOC: sleeplock2
-    release(&ptable.lock);
-    acquire(lk);
-  }
+  acquire(lk);
 }
 
 //PAGEBREAK!
-// Wake up all processes sleeping on chan.
-// The ptable lock must be held.
+// Take the sleeping process at *pp off its wait queue and make
+// it runnable. Caller holds the queue's lock.
 static void
-wakeup1(void *chan)
+wake(struct proc **pp)
 {
-  struct proc *p;
+  struct proc *p = *pp;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+  *pp = p->sqnext;
+  enqueue(p, p->cpu);
 }
 
 // Wake up all processes sleeping on chan.
 void
 wakeup(void *chan)
 {
-  acquire(&ptable.lock);
-  wakeup1(chan);
-  release(&ptable.lock);
+  struct sleepq *sq = SLEEPQ(chan);
+  struct proc **pp;
+
+  acquire(&sq->lock);
+  for(pp = &sq->head; *pp; ){
+    if((*pp)->chan == chan)
+      wake(pp);
+    else
+      pp = &(*pp)->sqnext;
+  }
+  release(&sq->lock);
 }
 
 // Kill the process with the given pid.
@@ -479,15 +851,27 @@ wakeup(void *chan)
 int
 kill(int pid)
 {
-  struct proc *p;
+  struct proc *p, **pp;
+  struct sleepq *sq;
+  void *chan;
 
   acquire(&ptable.lock);
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
     if(p->pid == pid){
       p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
+      // Wake process from sleep if necessary. Its channel is only
+      // stable under the channel's wait queue lock, so check again.
+      while(p->state == SLEEPING){
+        chan = p->chan;
+        sq = SLEEPQ(chan);
+        acquire(&sq->lock);
+        if(p->state == SLEEPING && p->chan == chan){
+          for(pp = &sq->head; *pp != p; pp = &(*pp)->sqnext)
+            ;
+          wake(pp);
+        }
+        release(&sq->lock);
+      }
       release(&ptable.lock);
       return 0;
     }
@@ -496,6 +880,92 @@ kill(int pid)
   return -1;
 }
 
+// Restrict the current process to the CPUs in mask, bit i for CPU i,
+// or let it use any if mask is 0. Returns the CPU it is running on
+// afterwards, or -1 if mask names no CPU.
+int
+setaffinity(uint mask)
+{
+  struct proc *p = myproc();
+  int id;
+
+  if(mask != 0 && (mask & ((1 << ncpu) - 1)) == 0)
+    return -1;
+  p->affinity = mask;
+  pushcli();
+  id = cpuid();
+  popcli();
+  if(!allowed(p, id)){
+    yield();    // scheduler() moves p to a CPU in mask
+    pushcli();
+    id = cpuid();
+    popcli();
+  }
+  return id;
+}
+
+// Has a process that should run before the current one been queued
+// on this CPU? Then it should yield.
+int
+preempted(void)
+{
+  int r;
+
+  pushcli();
+  r = mycpu()->resched;
+  popcli();
+  return r;
+}
+
+// Set the scheduling class and priority of process pid, or of the
+// current process if pid is 0: a nice value for SCHED_FAIR or a
+// priority for SCHED_RT. Returns 0, or -1 for a bad class, priority
+// or pid.
+int
+setpriority(int pid, int class, int prio)
+{
+  struct proc *p, *curproc = myproc();
+  struct runq *rq;
+  int queued;
+
+  if(class == SCHED_FAIR){
+    if(prio < NICE_MIN || prio > NICE_MAX)
+      return -1;
+  } else if(class == SCHED_RT){
+    if(prio < 0 || prio >= NRTPRIO)
+      return -1;
+  } else
+    return -1;
+
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->state != UNUSED && p->state != ZOMBIE &&
+       (pid == 0 ? p == curproc : p->pid == pid))
+      break;
+  if(p == &ptable.proc[NPROC]){
+    release(&ptable.lock);
+    return -1;
+  }
+  // A queued p must be moved to the list for its new priority.
+  rq = &runq[p->cpu];
+  acquire(&rq->lock);
+  queued = p->state == RUNNABLE && rqremove(rq, p);
+  if(class == SCHED_FAIR)
+    p->nice = prio;
+  else
+    p->rtprio = prio;
+  p->class = class;
+  if(queued)
+    rqpush(rq, p);
+  release(&rq->lock);
+  release(&ptable.lock);
+
+  // Let the scheduler reconsider, in case p now ranks lower.
+  if(p == curproc)
+    yield();
+  return 0;
+}
+
 //PAGEBREAK: 36
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
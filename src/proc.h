@@ -8,6 +8,8 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  int resched;                 // A process that should preempt proc is queued
+  volatile uint idle;          // Halted in scheduler() until there is work
 };
 
 extern struct cpu cpus[NCPU];
@@ -35,6 +37,25 @@ struct context {
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
+// A program segment that is read in from the program file a page at
+// a time, as it is first touched. Bytes past filesz are zero.
+struct seg {
+  uint va;                     // page-aligned start
+  uint off;                    // file offset of va
+  uint filesz;
+  uint memsz;
+};
+
+// A region mapped with mmap(); unused if len is 0.
+struct vma {
+  uint va;
+  uint len;                    // bytes, a multiple of PGSIZE
+  int prot;                    // PROT_*
+  int flags;                   // MAP_*
+  struct file *f;              // 0 for MAP_ANON
+  uint off;                    // file offset of va
+};
+
 struct proc {
   uint sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
@@ -49,6 +70,21 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  struct uringctx *uring;      // Shared I/O ring, or 0
+  struct nic_device *netmap;   // NIC mapped at NETMAPVA, or 0
+  struct inode *exe;           // Program file, for demand loading, or 0
+  int nseg;
+  struct seg seg[NSEG];        // Parts of the address space backed by exe
+  struct vma vma[NVMA];        // mmap() regions
+  int cpu;                     // CPU whose run queue has or last ran it
+  uint affinity;               // CPUs it may run on, bit i for CPU i; 0 for any
+  struct proc *rqnext;         // Next on the run queue
+  struct proc *sqnext;         // Next sleeper in the same wait queue
+  int class;                   // SCHED_FAIR or SCHED_RT
+  int nice;                    // SCHED_FAIR weight, NICE_MIN..NICE_MAX
+  int rtprio;                  // SCHED_RT priority, 0..NRTPRIO-1
+  uint64_t vruntime;           // SCHED_FAIR run time, scaled by weight (ns)
+  uint64_t runstart;           // nsecs() when last switched to
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -0,0 +1,156 @@
+// Echo frames between two processes over packet sockets, first with
+// one read and one write system call per frame, then in batches
+// through a uring, and report how long each took.
+//
+// usage: ringecho [frames [interface]]
+
+#include "types.h"
+#include "user.h"
+#include "uring.h"
+
+#define REQTYPE   0x88b6    // IEEE local experimental ethertypes
+#define REPTYPE   0x88b7
+#define FRAMELEN  64
+#define BATCH     8         // frames a socket queues
+
+static char buf[BATCH][FRAMELEN];
+
+static uint
+elapsedus(uint64_t start)
+{
+  uint64_t now, d;
+  uint s = 0;
+
+  nsecs(&now);
+  d = now - start;
+  while(d >= 1000000000ULL){
+    d -= 1000000000ULL;
+    s++;
+  }
+  return s*1000000 + (uint)d/1000;
+}
+
+static void
+settype(char *f, int type)
+{
+  f[12] = type >> 8;
+  f[13] = type & 0xff;
+}
+
+static void
+post(struct uring *r, int op, int fd, char *addr, int len, uint user_data)
+{
+  struct uring_sqe *sqe = &r->sq[r->sq_tail % URING_ENTRIES];
+
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->addr = (uint)addr;
+  sqe->len = len;
+  sqe->user_data = user_data;
+  r->sq_tail++;
+}
+
+// Submit everything posted and wait for n completions.
+static void
+complete(struct uring *r, int n, int reply, int s)
+{
+  struct uring_cqe *cqe;
+  int posted = 0;
+
+  uring_enter(n, n);
+  while(r->cq_head != r->cq_tail){
+    cqe = &r->cq[r->cq_head % URING_ENTRIES];
+    if(cqe->res < 0){
+      printf(2, "ringecho: operation %d failed\n", cqe->user_data);
+      exit();
+    }
+    if(reply && cqe->user_data < BATCH){
+      settype(buf[cqe->user_data], REPTYPE);
+      post(r, URING_OP_WRITE, s, buf[cqe->user_data], FRAMELEN, BATCH + cqe->user_data);
+      posted++;
+    }
+    r->cq_head++;
+  }
+  if(posted)
+    complete(r, posted, 0, s);
+}
+
+static void
+server(int s, int n)
+{
+  struct uring *r;
+  int i, k, done;
+
+  for(i = 0; i < n; i++){
+    read(s, buf[0], FRAMELEN);
+    settype(buf[0], REPTYPE);
+    write(s, buf[0], FRAMELEN);
+  }
+
+  r = uring_setup();
+  for(done = 0; done < n; done += k){
+    k = n - done < BATCH ? n - done : BATCH;
+    for(i = 0; i < k; i++)
+      post(r, URING_OP_READ, s, buf[i], FRAMELEN, i);
+    complete(r, k, 1, s);
+  }
+  exit();
+}
+
+static void
+client(int s, int n)
+{
+  static char in[BATCH][FRAMELEN];
+  struct uring *r;
+  uint64_t start;
+  int i, k, done;
+
+  memset(buf, 0xff, sizeof(buf));
+  for(i = 0; i < BATCH; i++)
+    settype(buf[i], REQTYPE);
+
+  nsecs(&start);
+  for(i = 0; i < n; i++){
+    write(s, buf[0], FRAMELEN);
+    if(read(s, in[0], FRAMELEN) != FRAMELEN){
+      printf(2, "ringecho: short reply\n");
+      exit();
+    }
+  }
+  printf(1, "read/write: %d round trips in %d us, %d system calls\n",
+         n, elapsedus(start), 2*n);
+
+  r = uring_setup();
+  nsecs(&start);
+  for(done = 0; done < n; done += k){
+    k = n - done < BATCH ? n - done : BATCH;
+    for(i = 0; i < k; i++)
+      post(r, URING_OP_WRITE, s, buf[i], FRAMELEN, BATCH + i);
+    for(i = 0; i < k; i++)
+      post(r, URING_OP_READ, s, in[i], FRAMELEN, 2*BATCH + i);
+    complete(r, 2*k, 0, s);
+  }
+  printf(1, "uring:      %d round trips in %d us, %d system calls\n",
+         n, elapsedus(start), 2*((n + BATCH - 1) / BATCH));
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *iface = "lo";
+  int n = 2000, req, rep;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(argc > 2)
+    iface = argv[2];
+  if((req = socket(iface, REQTYPE)) < 0 || (rep = socket(iface, REPTYPE)) < 0){
+    printf(2, "ringecho: cannot open sockets on %s\n", iface);
+    exit();
+  }
+  if(fork() == 0)
+    server(req, n);
+  client(rep, n);
+  wait();
+  exit();
+}
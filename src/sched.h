@@ -0,0 +1,12 @@
+#ifndef XV6_SCHED_H
+#define XV6_SCHED_H
+
+// setpriority() scheduling classes
+#define SCHED_FAIR   0      // time-shared in proportion to weight by nice
+#define SCHED_RT     1      // fixed priority, ahead of every SCHED_FAIR process
+
+#define NICE_MIN     (-20)  // SCHED_FAIR: largest share of the CPU
+#define NICE_MAX     19
+#define NRTPRIO      8      // SCHED_RT priorities 0..NRTPRIO-1, higher first
+
+#endif // XV6_SCHED_H
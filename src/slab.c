@@ -0,0 +1,235 @@
+// Object caches for small kernel objects.
+//
+// A cache hands out objects of one size, carved from slabs: pages
+// that start with a struct slab and hold as many objects as fit after
+// it. Slabs with free objects are on the cache's partial list; a slab
+// whose objects are all free again goes back to kalloc() unless it is
+// the cache's last.
+//
+// Each CPU keeps a magazine, a small stack of free objects, for each
+// cache, so most allocations and frees touch neither the cache's lock
+// nor the slabs. An empty magazine is refilled with half a magazine of
+// objects and a full one gives half of its objects back.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "slabstat.h"
+
+#define NSLABCACHE  8    // caches, system-wide
+#define MAGSIZE     16   // objects per magazine
+
+struct slab {
+  struct slab *next;          // partial list; unlinked while full
+  struct slab *prev;
+  struct slabcache *cache;
+  int inuse;                  // objects handed out
+  void *free;                 // first free object
+};
+
+#define SLABHDR  ((sizeof(struct slab) + 7) & ~7)
+
+struct magazine {
+  int n;
+  void *obj[MAGSIZE];
+};
+
+struct slabcache {
+  struct spinlock lock;
+  char *name;
+  uint size;                  // object size, a multiple of 8
+  int perslab;                // objects in a slab
+  int nslabs;
+  int nobj;                   // objects out of the slabs, magazines included
+  uint refills, drains, grows, shrinks;
+  struct slab *partial;       // slabs with free objects
+  struct magazine mag[NCPU];  // only touched by their CPU, interrupts off
+};
+
+static struct {
+  struct spinlock lock;
+  int n;
+  struct slabcache cache[NSLABCACHE];
+} slabtable;
+
+void
+slabinit(void)
+{
+  initlock(&slabtable.lock, "slabtable");
+}
+
+// Create a cache of size-byte objects. Only called during boot.
+struct slabcache*
+slabcreate(char *name, uint size)
+{
+  struct slabcache *c;
+
+  size = (size + 7) & ~7;
+  if(size < sizeof(void*) || size > PGSIZE - SLABHDR)
+    panic("slabcreate: size");
+  acquire(&slabtable.lock);
+  if(slabtable.n == NSLABCACHE)
+    panic("slabcreate: too many caches");
+  c = &slabtable.cache[slabtable.n++];
+  release(&slabtable.lock);
+  memset(c, 0, sizeof(*c));
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - SLABHDR) / size;
+  return c;
+}
+
+static void
+slablink(struct slabcache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(s->next)
+    s->next->prev = s;
+  c->partial = s;
+}
+
+static void
+slabunlink(struct slabcache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+// Take one object from the slabs. Caller holds c->lock.
+static void*
+getobj(struct slabcache *c)
+{
+  struct slab *s;
+  char *o;
+  int i;
+
+  if((s = c->partial) == 0){
+    if((s = (struct slab*)kalloc()) == 0)
+      return 0;
+    s->cache = c;
+    s->inuse = 0;
+    s->free = 0;
+    // thread the free list through the objects, lowest address first
+    for(i = c->perslab - 1; i >= 0; i--){
+      o = (char*)s + SLABHDR + i*c->size;
+      *(void**)o = s->free;
+      s->free = o;
+    }
+    slablink(c, s);
+    c->nslabs++;
+    c->grows++;
+  }
+  o = s->free;
+  s->free = *(void**)o;
+  s->inuse++;
+  c->nobj++;
+  if(s->free == 0)
+    slabunlink(c, s);
+  return o;
+}
+
+// Return one object to its slab. Caller holds c->lock.
+static void
+putobj(struct slabcache *c, void *o)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint)o);
+
+  if(s->free == 0)
+    slablink(c, s);
+  *(void**)o = s->free;
+  s->free = o;
+  s->inuse--;
+  c->nobj--;
+  if(s->inuse == 0 && (c->partial != s || s->next)){
+    slabunlink(c, s);
+    c->nslabs--;
+    c->shrinks++;
+    kfree((char*)s);
+  }
+}
+
+void*
+slaballoc(struct slabcache *c)
+{
+  struct magazine *m;
+  void *o;
+
+  pushcli();
+  m = &c->mag[cpuid()];
+  if(m->n == 0){
+    acquire(&c->lock);
+    while(m->n < MAGSIZE/2 && (o = getobj(c)) != 0)
+      m->obj[m->n++] = o;
+    c->refills++;
+    release(&c->lock);
+  }
+  o = m->n > 0 ? m->obj[--m->n] : 0;
+  popcli();
+  return o;
+}
+
+void
+slabfree(struct slabcache *c, void *o)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint)o);
+  struct magazine *m;
+
+  if(s->cache != c || ((char*)o - (char*)s - SLABHDR) % c->size)
+    panic("slabfree");
+#ifdef KALLOC_DEBUG
+  memset(o, 1, c->size);
+#endif
+  pushcli();
+  m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE){
+    acquire(&c->lock);
+    while(m->n > MAGSIZE/2)
+      putobj(c, m->obj[--m->n]);
+    c->drains++;
+    release(&c->lock);
+  }
+  m->obj[m->n++] = o;
+  popcli();
+}
+
+// Copy the counters of up to n caches to st[]; returns how many.
+// Other CPUs' magazines are read without stopping them, so cached
+// and inuse may be off by the objects moving meanwhile.
+int
+slabstat(struct slabstat *st, int n)
+{
+  struct slabcache *c;
+  int i, k, ncache;
+
+  acquire(&slabtable.lock);
+  ncache = slabtable.n;
+  release(&slabtable.lock);
+  for(i = 0; i < ncache && i < n; i++){
+    c = &slabtable.cache[i];
+    memset(&st[i], 0, sizeof(st[i]));
+    safestrcpy(st[i].name, c->name, sizeof(st[i].name));
+    st[i].size = c->size;
+    st[i].perslab = c->perslab;
+    for(k = 0; k < NCPU; k++)
+      st[i].cached += c->mag[k].n;
+    acquire(&c->lock);
+    st[i].slabs = c->nslabs;
+    st[i].inuse = c->nobj - st[i].cached;
+    st[i].refills = c->refills;
+    st[i].drains = c->drains;
+    st[i].grows = c->grows;
+    st[i].shrinks = c->shrinks;
+    release(&c->lock);
+  }
+  return i;
+}
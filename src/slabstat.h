@@ -0,0 +1,18 @@
+#ifndef XV6_SLABSTAT_H
+#define XV6_SLABSTAT_H
+
+// Counters for one object cache, returned by the slabstat system call.
+struct slabstat {
+  char name[16];
+  uint size;        // bytes per object
+  uint perslab;     // objects in a slab, which is one page
+  uint slabs;       // pages the cache holds now
+  uint inuse;       // objects handed out
+  uint cached;      // free objects waiting in CPU magazines
+  uint refills;     // magazines refilled from the slabs
+  uint drains;      // magazines that gave half their objects back
+  uint grows;       // slabs taken from kalloc()
+  uint shrinks;     // empty slabs given back to kfree()
+};
+
+#endif // XV6_SLABSTAT_H
@@ -0,0 +1,203 @@
+// Packet sockets. A socket is bound to one interface and one
+// ethertype, and receives the frames of that type that no kernel
+// protocol consumes. Each write sends one raw ethernet frame.
+//
+// Received frames are pulled from the NIC by whoever reads or polls
+// a socket on it; the NIC's wait queue tells blocked readers and
+// pollers when there may be something to pull.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "poll.h"
+#include "nic.h"
+#include "ethernet.h"
+#include "arp_frame.h"
+
+#define SOCK_SLOTS    8     // frames queued per socket
+#define SOCK_FRAMES_PER_PAGE  (PGSIZE / 2048)
+
+struct sock {
+  struct sock *next;                // on socktable.list
+  struct spinlock lock;
+  struct nic_device *nd;
+  uint16_t ethertype;
+  uint nread;                       // number of frames read
+  uint nwrite;                      // number of frames queued
+  uint drops;                       // frames dropped, queue full
+  uint16_t len[SOCK_SLOTS];
+  uint8_t *frame[SOCK_SLOTS];       // NIC_FRAME_MAX bytes each
+};
+
+// socktable.lock protects the list of open sockets and is held while
+// a frame is queued, so a socket cannot be freed under sock_input.
+static struct {
+  struct spinlock lock;
+  struct sock *list;
+} socktable;
+
+static struct slabcache *sockcache;
+
+void
+sockinit(void)
+{
+  initlock(&socktable.lock, "socktable");
+  sockcache = slabcreate("sock", sizeof(struct sock));
+}
+
+// Bind a new socket to frames of ethertype arriving on nd.
+// Only one socket may be bound to each (nd, ethertype).
+struct sock*
+sockalloc(struct nic_device *nd, uint16_t ethertype)
+{
+  struct sock *s, *t;
+  uint8_t *frame[SOCK_SLOTS];
+  char *mem = 0;
+  int i;
+
+  memset(frame, 0, sizeof(frame));
+  for(i = 0; i < SOCK_SLOTS; i++){
+    if(i % SOCK_FRAMES_PER_PAGE == 0 && (mem = kalloc()) == 0)
+      goto bad;
+    frame[i] = (uint8_t*)mem + (i % SOCK_FRAMES_PER_PAGE) * 2048;
+  }
+
+  if((s = (struct sock*)slaballoc(sockcache)) == 0)
+    goto bad;
+  initlock(&s->lock, "sock");
+  s->nd = nd;
+  s->ethertype = ethertype;
+  s->nread = s->nwrite = s->drops = 0;
+  memmove(s->frame, frame, sizeof(frame));
+
+  acquire(&socktable.lock);
+  for(t = socktable.list; t; t = t->next){
+    if(t->nd == nd && t->ethertype == ethertype){
+      release(&socktable.lock);
+      slabfree(sockcache, s);
+      goto bad;
+    }
+  }
+  s->next = socktable.list;
+  socktable.list = s;
+  release(&socktable.lock);
+  return s;
+
+ bad:
+  for(i = 0; i < SOCK_SLOTS; i += SOCK_FRAMES_PER_PAGE)
+    if(frame[i])
+      kfree((char*)frame[i]);
+  return 0;
+}
+
+void
+sockclose(struct sock *s)
+{
+  struct sock **pp;
+  int i;
+
+  acquire(&socktable.lock);
+  for(pp = &socktable.list; *pp != s; pp = &(*pp)->next)
+    ;
+  *pp = s->next;
+  release(&socktable.lock);
+  for(i = 0; i < SOCK_SLOTS; i += SOCK_FRAMES_PER_PAGE)
+    kfree((char*)s->frame[i]);
+  slabfree(sockcache, s);
+}
+
+// Queue a frame nobody in the kernel claimed for the socket bound to
+// its ethertype. Returns 1 if a socket took (or dropped) it.
+int
+sock_input(struct nic_device *nd, uint8_t *frame, uint16_t length)
+{
+  uint16_t ethertype = ntohs(*(uint16_t*)(frame + 2*ETH_ADDR_LEN));
+  struct sock *s;
+
+  acquire(&socktable.lock);
+  for(s = socktable.list; s; s = s->next)
+    if(s->nd == nd && s->ethertype == ethertype)
+      break;
+  if(s == 0){
+    release(&socktable.lock);
+    return 0;
+  }
+  acquire(&s->lock);
+  if(s->nwrite == s->nread + SOCK_SLOTS){
+    s->drops++;
+  } else {
+    memmove(s->frame[s->nwrite % SOCK_SLOTS], frame, length);
+    s->len[s->nwrite % SOCK_SLOTS] = length;
+    s->nwrite++;
+  }
+  release(&s->lock);
+  release(&socktable.lock);
+  // Whoever pulled the frame off the NIC may not be the reader.
+  nic_rxready(nd->driver);
+  return 1;
+}
+
+// Pull everything the NIC has received through the protocol handlers.
+static void
+sockdrain(struct nic_device *nd)
+{
+  char *buf;
+
+  if((buf = kalloc()) == 0)
+    return;
+  net_poll(nd, (uint8_t*)buf);
+  kfree(buf);
+}
+
+int
+sockread(struct sock *s, char *addr, int n)
+{
+  uint gen;
+  int len;
+
+  for(;;){
+    gen = s->nd->rxgen;
+    sockdrain(s->nd);
+    acquire(&s->lock);
+    if(s->nread != s->nwrite){
+      len = s->len[s->nread % SOCK_SLOTS];
+      if(len > n)
+        len = n;   // rest of the frame is discarded
+      memmove(addr, s->frame[s->nread % SOCK_SLOTS], len);
+      s->nread++;
+      release(&s->lock);
+      return len;
+    }
+    release(&s->lock);
+    if(myproc()->killed)
+      return -1;
+    nic_rxwait(s->nd, gen);
+  }
+}
+
+int
+sockwrite(struct sock *s, char *addr, int n)
+{
+  if(n < ETH_HDR_LEN || n > NIC_FRAME_MAX)
+    return -1;
+  s->nd->send_packet(s->nd->driver, (uint8_t*)addr, n);
+  return n;
+}
+
+int
+sockpoll(struct sock *s, struct pollent *pe)
+{
+  int r = POLLOUT;
+
+  if(pe)
+    nic_pollwait(s->nd, pe);
+  sockdrain(s->nd);
+  acquire(&s->lock);
+  if(s->nread != s->nwrite)
+    r |= POLLIN;
+  release(&s->lock);
+  return r;
+}
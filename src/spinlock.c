@@ -8,13 +8,37 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "lockstat.h"
+
+// Locks in the kernel's data and bss, for lockstat(). Locks in
+// allocated memory are not listed, since they may be freed.
+#define NLOCKS  512
+
+extern char data[], end[];  // defined by kernel.ld
+static struct spinlock *locks[NLOCKS];
+static uint nlocks;
 
 void
 initlock(struct spinlock *lk, char *name)
 {
+  uint i;
+
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->acquires = 0;
+  lk->contended = 0;
+  lk->spins = 0;
+  lk->maxhold = 0;
+
+  if((char*)lk < data || (char*)lk >= end)
+    return;
+  for(i = 0; i < nlocks && i < NLOCKS; i++)
+    if(locks[i] == lk)
+      return;
+  if((i = xadd(&nlocks, 1)) < NLOCKS)
+    locks[i] = lk;
 }
 
 // Acquire the lock.
@@ -24,13 +48,17 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket, spins;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // The xadd is atomic: each CPU gets its own ticket, and waits
+  // until release() has advanced owner to it.
+  ticket = xadd(&lk->next, 1);
+  for(spins = 0; lk->owner != ticket; spins++)
+    pause();
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,15 +68,26 @@ acquire(struct spinlock *lk)
   // Record info about lock acquisition for debugging.
   lk->cpu = mycpu();
   getcallerpcs(&lk, lk->pcs);
+  lk->acquires++;
+  if(spins){
+    lk->contended++;
+    lk->spins += spins;
+  }
+  lk->tacquired = rdtsc();
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
+  uint held;
+
   if(!holding(lk))
     panic("release");
 
+  held = (uint)(rdtsc() - lk->tacquired);
+  if(held > lk->maxhold)
+    lk->maxhold = held;
   lk->pcs[0] = 0;
   lk->cpu = 0;
 
@@ -59,14 +98,55 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  // Let the next ticket in. Only the holder writes owner, so a
+  // plain increment will do, but it must be a single store.
+  asm volatile("incl %0" : "+m" (lk->owner));
 
   popcli();
 }
 
+// Is some CPU holding lk? Only a hint, unless the caller holds it.
+int
+lockbusy(struct spinlock *lk)
+{
+  return lk->next != lk->owner;
+}
+
+// Fill st[0..n-1] with the counters of the listed locks, summed over
+// locks with the same name, and return how many entries it filled.
+int
+lockstat(struct lockstat *st, int n)
+{
+  struct spinlock *lk;
+  struct lockstat *s;
+  uint i;
+  int j, nnames;
+
+  nnames = 0;
+  for(i = 0; i < nlocks && i < NLOCKS; i++){
+    if((lk = locks[i]) == 0)
+      continue;
+    for(j = 0; j < nnames; j++)
+      if(strncmp(st[j].name, lk->name, sizeof(st[j].name) - 1) == 0)
+        break;
+    if(j == nnames){
+      if(nnames == n)
+        continue;
+      nnames++;
+      memset(&st[j], 0, sizeof(st[j]));
+      safestrcpy(st[j].name, lk->name, sizeof(st[j].name));
+    }
+    s = &st[j];
+    s->nlocks++;
+    s->acquires += lk->acquires;
+    s->contended += lk->contended;
+    s->spins += lk->spins;
+    if(lk->maxhold > s->maxhold)
+      s->maxhold = lk->maxhold;
+  }
+  return nnames;
+}
+
 // Record the current call stack in pcs[] by following the %ebp chain.
 void
 getcallerpcs(void *v, uint pcs[])
@@ -89,7 +169,7 @@ getcallerpcs(void *v, uint pcs[])
 int
 holding(struct spinlock *lock)
 {
-  return lock->locked && lock->cpu == mycpu();
+  return lockbusy(lock) && lock->cpu == mycpu();
 }
 
 
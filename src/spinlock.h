@@ -1,11 +1,24 @@
-// Mutual exclusion lock.
+#ifndef XV6_SPINLOCK_H
+#define XV6_SPINLOCK_H
+
+// Mutual exclusion lock. CPUs take tickets and are let in one at a
+// time in ticket order, so a waiting CPU cannot be starved.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  volatile uint next;  // Next ticket to hand out
+  volatile uint owner; // Ticket now holding the lock; free if == next
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+
+  // For lockstat(), updated only by the holder:
+  uint acquires;
+  uint contended;    // acquires that had to wait
+  uint spins;        // turns of the wait loop
+  uint maxhold;      // longest hold, in TSC cycles
+  uint64_t tacquired; // rdtsc() when acquired
 };
 
+#endif
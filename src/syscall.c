@@ -52,23 +52,41 @@ argint(int n, int *ip)
   return fetchint((myproc()->tf->esp) + 4 + 4*n, ip);
 }
 
-// Fetch the nth word-sized system call argument as a pointer
-// to a block of memory of size bytes.  Check that the pointer
-// lies within the process address space.
-int
-argptr(int n, char **pp, int size)
+static int
+fetchptr(int n, char **pp, int size, int write)
 {
   int i;
   struct proc *curproc = myproc();
  
   if(argint(n, &i) < 0)
     return -1;
-  if(size < 0 || (uint)i >= curproc->sz || (uint)i+size > curproc->sz)
+  if(size < 0 || (uint)i >= USERTOP || !uvmaccess(curproc, i, size, write))
+    return -1;
+  // The buffer may be used with locks held, when faults can't sleep
+  // or fail.
+  if(uvmtouch(curproc, i, size, write) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
 }
 
+// Fetch the nth word-sized system call argument as a pointer
+// to a block of memory of size bytes.  Check that the pointer
+// lies within the process address space and may be written.
+int
+argptr(int n, char **pp, int size)
+{
+  return fetchptr(n, pp, size, 1);
+}
+
+// Like argptr, for a buffer the kernel only reads: it may lie in a
+// read-only mapping.
+int
+argbuf(int n, char **pp, int size)
+{
+  return fetchptr(n, pp, size, 0);
+}
+
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
 // (There is no shared writable memory, so the string can't change
@@ -106,6 +124,25 @@ extern int sys_uptime(void);
 extern int sys_arp(void);
 extern int sys_checknic(void);
 extern int sys_icmptest(void);
+extern int sys_netsend(void);
+extern int sys_netrecv(void);
+extern int sys_nicctl(void);
+extern int sys_nsecs(void);
+extern int sys_poll(void);
+extern int sys_socket(void);
+extern int sys_uring_setup(void);
+extern int sys_uring_enter(void);
+extern int sys_netmap(void);
+extern int sys_nmsync(void);
+extern int sys_kmemstat(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_yield(void);
+extern int sys_setaffinity(void);
+extern int sys_setpriority(void);
+extern int sys_usleep(void);
+extern int sys_lockstat(void);
+extern int sys_slabstat(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -132,6 +169,25 @@ static int (*syscalls[])(void) = {
 [SYS_arp]     sys_arp,
 [SYS_checknic] sys_checknic,
 [SYS_icmptest] sys_icmptest,
+[SYS_netsend] sys_netsend,
+[SYS_netrecv] sys_netrecv,
+[SYS_nicctl]  sys_nicctl,
+[SYS_nsecs]   sys_nsecs,
+[SYS_poll]    sys_poll,
+[SYS_socket]  sys_socket,
+[SYS_uring_setup] sys_uring_setup,
+[SYS_uring_enter] sys_uring_enter,
+[SYS_netmap]  sys_netmap,
+[SYS_nmsync]  sys_nmsync,
+[SYS_kmemstat] sys_kmemstat,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_yield]   sys_yield,
+[SYS_setaffinity] sys_setaffinity,
+[SYS_setpriority] sys_setpriority,
+[SYS_usleep]  sys_usleep,
+[SYS_lockstat] sys_lockstat,
+[SYS_slabstat] sys_slabstat,
 };
 
 void
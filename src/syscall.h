@@ -22,4 +22,23 @@
 #define SYS_close  21
 #define SYS_arp    22
 #define SYS_checknic 23
-#define SYS_icmptest 24
\ No newline at end of file
+#define SYS_icmptest 24
+#define SYS_netsend 25
+#define SYS_netrecv 26
+#define SYS_nicctl 27
+#define SYS_nsecs  28
+#define SYS_poll   29
+#define SYS_socket 30
+#define SYS_uring_setup 31
+#define SYS_uring_enter 32
+#define SYS_netmap 33
+#define SYS_nmsync 34
+#define SYS_kmemstat 35
+#define SYS_mmap   36
+#define SYS_munmap 37
+#define SYS_yield  38
+#define SYS_setaffinity 39
+#define SYS_setpriority 40
+#define SYS_usleep 41
+#define SYS_lockstat 42
+#define SYS_slabstat 43
\ No newline at end of file
@@ -4,6 +4,8 @@
 // user code, and calls into file.c and fs.c.
 //
 #include "e1000.h"
+#include "ethernet.h"
+#include "ip.h"
 
 #include "types.h"
 #include "defs.h"
@@ -18,6 +20,8 @@
 #include "fcntl.h"
 #include "x86.h"
 #include "memlayout.h"
+#include "poll.h"
+#include "mman.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -88,7 +92,7 @@ sys_write(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argbuf(1, &p, n) < 0)
     return -1;
   return filewrite(f, p, n);
 }
@@ -447,6 +451,110 @@ sys_pipe(void)
   return 0;
 }
 
+int
+sys_poll(void)
+{
+  struct pollfd *fds;
+  struct file *files[NOFILE];
+  int i, n, fd, timeout, r;
+
+  if(argint(1, &n) < 0 || argint(2, &timeout) < 0)
+    return -1;
+  if(n < 0 || n > NOFILE || argptr(0, (void*)&fds, n*sizeof(*fds)) < 0)
+    return -1;
+  // Hold a reference to every file while waiting on it.
+  for(i = 0; i < n; i++){
+    fd = fds[i].fd;
+    files[i] = 0;
+    if(fd >= 0 && fd < NOFILE && myproc()->ofile[fd])
+      files[i] = filedup(myproc()->ofile[fd]);
+  }
+  r = poll(files, fds, n, timeout);
+  for(i = 0; i < n; i++)
+    if(files[i])
+      fileclose(files[i]);
+  return r;
+}
+
+// Map a submission/completion ring into the process.
+int
+sys_uring_setup(void)
+{
+  return uringsetup();
+}
+
+int
+sys_uring_enter(void)
+{
+  int to_submit, min_complete;
+
+  if(argint(0, &to_submit) < 0 || argint(1, &min_complete) < 0)
+    return -1;
+  return uringenter(to_submit, min_complete);
+}
+
+// Map (on != 0) or unmap the rings and packet buffers of interface
+// at NETMAPVA, see netmap.h. Returns the mapping's address.
+int
+sys_netmap(void)
+{
+  char *interface;
+  int on;
+  struct nic_device *nd;
+
+  if(argstr(0, &interface) < 0 || argint(1, &on) < 0)
+    return -1;
+  if(get_device(interface, &nd) < 0)
+    return -1;
+  if(!on){
+    if(myproc()->netmap != nd)
+      return -1;
+    netmapfree(myproc());
+    return 0;
+  }
+  return nic_netmap(nd);
+}
+
+int
+sys_nmsync(void)
+{
+  int wait;
+
+  if(argint(0, &wait) < 0)
+    return -1;
+  return nic_nmsync(wait);
+}
+
+// Open a packet socket receiving the frames of ethertype that
+// arrive on interface and are not consumed by the kernel.
+int
+sys_socket(void)
+{
+  char *interface;
+  int ethertype, fd;
+  struct nic_device *nd;
+  struct file *f;
+  struct sock *s;
+
+  if(argstr(0, &interface) < 0 || argint(1, &ethertype) < 0)
+    return -1;
+  if(ethertype <= 0 || ethertype > 0xffff || get_device(interface, &nd) < 0)
+    return -1;
+  if((s = sockalloc(nd, ethertype)) == 0)
+    return -1;
+  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
+    if(f)
+      fileclose(f);
+    sockclose(s);
+    return -1;
+  }
+  f->type = FD_SOCK;
+  f->readable = 1;
+  f->writable = 1;
+  f->sock = s;
+  return fd;
+}
+
 
 uint16_t calc_checksum(uint16_t* buffer, int size)
 {
@@ -576,11 +684,30 @@ int send_icmpRequest(char* interface,char* tarips,uint8_t type,uint8_t code)
 int
 sys_icmptest(void)
 {
-    if(send_icmpRequest("mynet0", "10.0.2.2", 8, 0) < 0)
+    struct nic_device *nd;
+    uint8_t *frame;
+    uint replies;
+    int cnt;
+
+    replies = icmp_echo_replies();
+    if(send_icmpRequest("mynet0", "10.0.2.2", ICMP_ECHO_REQUEST, 0) < 0)
     {
         cprintf("ERROR:send request fails");
         return -1;
     }
+
+    // Wait for the ICMP handler to see the echo reply.
+    if(get_device("mynet0", &nd) < 0 || (frame = (uint8_t*)kalloc()) == 0)
+        return -1;
+    for(cnt = 0; icmp_echo_replies() == replies; cnt++){
+        if(cnt == 0xffff){
+            cprintf("no reply\n");
+            kfree((char*)frame);
+            return -1;
+        }
+        net_poll(nd, frame);
+    }
+    kfree((char*)frame);
     return 0;
 }
 
@@ -600,38 +727,32 @@ sys_arp(void)
     return -1;
   }
 
-    struct e1000* e1000p=(struct e1000*)nic_devices[0].driver;
-    uint8_t* p=(uint8_t*)kalloc();
-    uint8_t* pp=p;
-    uint16_t length=0;
-    uint16_t cnt=0;
-    while(1)
-    {
-        if(cnt==0xffff)
-        {
-            cprintf("no reply\n");
-            break;
-        }
-        ++cnt;
-
-        uint8_t mask=15;
-        e1000_recv(e1000p,p,&length);
-        if(length!=0)
-        {
-            cprintf("Receive packet:\n");
-            for(int i=0;i<length;++i)
-            {
-                if(i % 12==0 && i) cprintf("\n");
-                cprintf("%x%x ",((*p)>>4)&mask,(*p)&mask);
-                ++p;
-            }
-            cprintf("\n\n");
-            cprintf("ip %d.%d.%d.%d is at %x:%x:%x:%x:%x:%x\n",pp[28],pp[29],pp[30],pp[31],pp[22],pp[23],pp[24],pp[25],pp[26],pp[27]);
-            break;
-        }
+  struct nic_device *nd;
+  uint8_t *frame, mac[6];
+  uint32_t ip;
+  char mac_str[18];
+  int cnt;
+
+  if(get_device(interface, &nd) < 0 || (frame = (uint8_t*)kalloc()) == 0)
+    return -1;
+
+  // The ARP handler fills the cache as replies are polled in.
+  ip = get_ip(ipAddr, strlen(ipAddr));
+  for(cnt = 0; arp_lookup(ip, mac) < 0; cnt++){
+    if(cnt == 0xffff){
+      cprintf("no reply\n");
+      kfree((char*)frame);
+      return -1;
     }
-  return 0;
+    net_poll(nd, frame);
+  }
+  kfree((char*)frame);
 
+  unpack_mac(mac, mac_str);
+  cprintf("ip %s is at %s\n", ipAddr, mac_str);
+  if(size >= sizeof(mac_str))
+    safestrcpy(arpResp, mac_str, sizeof(mac_str));
+  return 0;
 }
 
 
@@ -652,7 +773,10 @@ sys_checknic(void)
     cprintf("Error: invalid parameter");
     return -1;
   }
-  struct e1000* e1000p=(struct e1000*)nic_devices[0].driver;
+  struct nic_device *nd;
+  if(get_device("mynet0", &nd) < 0)
+    return -1;
+  struct e1000* e1000p=(struct e1000*)nd->driver;
     uint32_t head = e1000_reg_read(E1000_RDH,e1000p);
     uint32_t tail = e1000_reg_read(E1000_RDT,e1000p);
 
@@ -675,4 +799,100 @@ sys_checknic(void)
   }
 
   return 0;
-}
\ No newline at end of file
+}
+
+// Send one raw ethernet frame on the named interface.
+int
+sys_netsend(void)
+{
+  char *interface, *frame;
+  int n;
+  struct nic_device *nd;
+
+  if(argstr(0, &interface) < 0 || argint(2, &n) < 0 || argbuf(1, &frame, n) < 0)
+    return -1;
+  if(n <= 0 || n > NIC_FRAME_MAX)
+    return -1;
+  if(get_device(interface, &nd) < 0)
+    return -1;
+  nd->send_packet(nd->driver, (uint8_t*)frame, n);
+  return n;
+}
+
+// Receive one raw ethernet frame of an ethertype no kernel protocol
+// handles, without blocking. Returns the frame length, or 0 if none
+// was waiting.
+// The buffer must be able to hold the largest frame.
+int
+sys_netrecv(void)
+{
+  char *interface, *frame;
+  int n;
+  uint16_t length;
+  struct nic_device *nd;
+
+  if(argstr(0, &interface) < 0 || argint(2, &n) < 0 || argptr(1, &frame, n) < 0)
+    return -1;
+  if(n < NIC_FRAME_MAX)
+    return -1;
+  if(get_device(interface, &nd) < 0)
+    return -1;
+  // Frames of registered protocols (ARP, IPv4) are consumed by the
+  // kernel; hand the first unclaimed one to the caller.
+  do {
+    nd->recv_packet(nd->driver, (uint8_t*)frame, &length);
+  } while(length != 0 && eth_input(nd, (uint8_t*)frame, length));
+  return length;
+}
+
+// Apply a NIC_CTL_* configuration operation to the named interface.
+// addr, when not null, is a 6-byte hardware address.
+int
+sys_nicctl(void)
+{
+  char *interface, *addr;
+  int op, arg, uaddr;
+  uint8_t mac[6];
+  struct nic_device *nd;
+
+  if(argstr(0, &interface) < 0 || argint(1, &op) < 0 || argint(2, &arg) < 0 ||
+     argint(3, &uaddr) < 0)
+    return -1;
+  if(uaddr && argbuf(3, &addr, sizeof(mac)) < 0)
+    return -1;
+  if(get_device(interface, &nd) < 0 || nd->ctl == 0)
+    return -1;
+  if(uaddr)
+    memmove(mac, addr, sizeof(mac));
+  if(nd->ctl(nd->driver, op, arg, uaddr ? mac : 0) < 0)
+    return -1;
+  if(op == NIC_CTL_RAR_SET && arg == 0)
+    memmove(nd->mac_addr, mac, sizeof(mac));  // new station address
+  return 0;
+}
+
+// Map a file, or anonymous memory if MAP_ANON is set and fd is
+// ignored. The address hint is ignored too.
+int
+sys_mmap(void)
+{
+  struct file *f = 0;
+  int len, prot, flags, off;
+
+  if(argint(1, &len) < 0 || argint(2, &prot) < 0 || argint(3, &flags) < 0 ||
+     argint(5, &off) < 0)
+    return -1;
+  if(!(flags & MAP_ANON) && argfd(4, 0, &f) < 0)
+    return -1;
+  return mmap(f, len, prot, flags, off);
+}
+
+int
+sys_munmap(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0)
+    return -1;
+  return munmap(addr, len);
+}
@@ -6,6 +6,9 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "kmemstat.h"
+#include "lockstat.h"
+#include "slabstat.h"
 
 int
 sys_fork(void)
@@ -60,32 +63,108 @@ int
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
-  if(argint(0, &n) < 0)
+  if(argint(0, &n) < 0 || n < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  return nsleep((uint64_t)n * TICKNS);
+}
+
+// sleep for n microseconds, not rounded to clock ticks.
+int
+sys_usleep(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0 || n < 0)
+    return -1;
+  return nsleep((uint64_t)n * 1000);
 }
 
-// return how many clock tick interrupts have occurred
-// since start.
+// return how many clock ticks have passed since start.
 int
 sys_uptime(void)
 {
-  uint xticks;
+  return div64(nsecs(), TICKNS);
+}
+
+// store the monotonic nanosecond clock in *ns.
+int
+sys_nsecs(void)
+{
+  uint64_t *ns;
+
+  if(argptr(0, (void*)&ns, sizeof(*ns)) < 0)
+    return -1;
+  *ns = nsecs();
+  return 0;
+}
+
+// copy the counters of up to n lock names to st[]; returns how many.
+int
+sys_lockstat(void)
+{
+  struct lockstat *st;
+  int n;
 
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  if(argint(1, &n) < 0 || n < 0 || n > 256)
+    return -1;
+  if(argptr(0, (void*)&st, n*sizeof(*st)) < 0)
+    return -1;
+  return lockstat(st, n);
+}
+
+// copy the counters of up to n object caches to st[]; returns how many.
+int
+sys_slabstat(void)
+{
+  struct slabstat *st;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0 || n > 64)
+    return -1;
+  if(argptr(0, (void*)&st, n*sizeof(*st)) < 0)
+    return -1;
+  return slabstat(st, n);
+}
+
+// copy the page allocator's counters to *st.
+int
+sys_kmemstat(void)
+{
+  struct kmemstat *st;
+
+  if(argptr(0, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  kmemstat(st);
+  return 0;
+}
+
+// give up the CPU to another runnable process, if any.
+int
+sys_yield(void)
+{
+  yield();
+  return 0;
+}
+
+// restrict the process to a set of CPUs; returns the CPU it is on.
+int
+sys_setaffinity(void)
+{
+  int mask;
+
+  if(argint(0, &mask) < 0)
+    return -1;
+  return setaffinity((uint)mask);
+}
+
+// set the scheduling class and priority of a process (0 for this one).
+int
+sys_setpriority(void)
+{
+  int pid, class, prio;
+
+  if(argint(0, &pid) < 0 || argint(1, &class) < 0 || argint(2, &prio) < 0)
+    return -1;
+  return setpriority(pid, class, prio);
 }
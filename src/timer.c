@@ -0,0 +1,235 @@
+// Kernel timers: functions to call at deadlines on the nsecs() clock.
+//
+// Pending timers are kept in a min-heap by deadline. The local APIC
+// timers run one-shot: CPU 0's is armed for the earliest deadline,
+// and a CPU running processes is also armed for the end of its time
+// slice. So an idle CPU takes no timer interrupts at all, and a
+// sleep ends when its deadline passes rather than on the next tick.
+// If the TSC could not be calibrated, the timers tick periodically
+// instead and each tick ends the time slice (see clockticks()).
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "traps.h"
+#include "spinlock.h"
+#include "mmu.h"
+#include "proc.h"
+#include "timer.h"
+
+#define NTIMER  (2*NPROC)      // one sleep and one poll per process
+
+static struct {
+  struct spinlock lock;
+  struct timer *heap[NTIMER];  // heap[0] expires first
+  int n;
+  uint64_t slice[NCPU];        // end of each CPU's time slice, 0 if idle
+} timers;
+
+static struct spinlock napslock;  // orders nsleep() against its timer
+
+void
+timerinit(void)
+{
+  initlock(&timers.lock, "timers");
+  initlock(&napslock, "naps");
+}
+
+static void
+put(int i, struct timer *t)
+{
+  timers.heap[i] = t;
+  t->slot = i;
+}
+
+// Move the timer at slot i up or down until the heap is in order.
+static void
+fix(int i)
+{
+  struct timer *t = timers.heap[i];
+  int c;
+
+  while(i > 0 && timers.heap[(i-1)/2]->when > t->when){
+    put(i, timers.heap[(i-1)/2]);
+    i = (i-1)/2;
+  }
+  for(;;){
+    c = 2*i + 1;
+    if(c >= timers.n)
+      break;
+    if(c+1 < timers.n && timers.heap[c+1]->when < timers.heap[c]->when)
+      c++;
+    if(timers.heap[c]->when >= t->when)
+      break;
+    put(i, timers.heap[c]);
+    i = c;
+  }
+  put(i, t);
+}
+
+// Take t out of the heap. Caller holds timers.lock.
+static void
+remove(struct timer *t)
+{
+  int i = t->slot;
+
+  t->slot = TIMER_IDLE;
+  if(--timers.n == i)
+    return;
+  put(i, timers.heap[timers.n]);
+  fix(i);
+}
+
+// Program this CPU's timer for its next event. Caller holds
+// timers.lock, with interrupts off.
+static void
+arm(void)
+{
+  uint64_t next, now;
+  int id = cpuid();
+
+  next = timers.slice[id];
+  if(id == 0 && timers.n > 0 && (next == 0 || timers.heap[0]->when < next))
+    next = timers.heap[0]->when;
+  if(next == 0){
+    lapicarm(0);
+    return;
+  }
+  now = nsecs();
+  lapicarm(next > now ? next - now : 1);
+}
+
+// Reprogram this CPU's timer, after another CPU queued an earlier
+// deadline.
+void
+timerarm(void)
+{
+  acquire(&timers.lock);
+  arm();
+  release(&timers.lock);
+}
+
+// Call fn(arg) from the timer interrupt once nsecs() reaches when.
+// t must not be pending already.
+void
+timeradd(struct timer *t, uint64_t when, void (*fn)(void*), void *arg)
+{
+  int first;
+
+  acquire(&timers.lock);
+  if(t->slot != TIMER_IDLE)
+    panic("timeradd");
+  if(timers.n == NTIMER)
+    panic("timeradd: too many timers");
+  t->when = when;
+  t->fn = fn;
+  t->arg = arg;
+  put(timers.n++, t);
+  fix(t->slot);
+  first = timers.heap[0] == t;
+  if(first && cpuid() == 0)
+    arm();
+  release(&timers.lock);
+
+  // CPU 0 keeps time for everyone.
+  if(first && ncpu > 1){
+    pushcli();
+    if(cpuid() != 0)
+      lapicipi(cpus[0].apicid, T_IRQ0 + IRQ_RESCHED);
+    popcli();
+  }
+}
+
+// Cancel t if it is pending, and wait for its function to return if
+// it is running, so that the caller may free t. Must not be called
+// with a lock that t's function acquires.
+void
+timerdel(struct timer *t)
+{
+  acquire(&timers.lock);
+  if(t->slot >= 0)
+    remove(t);
+  while(t->slot == TIMER_FIRING){
+    release(&timers.lock);
+    acquire(&timers.lock);
+  }
+  release(&timers.lock);
+}
+
+// Start or stop time-slicing this CPU: busy is whether it is running
+// processes. Called by scheduler(), with interrupts off.
+void
+timerslice(int busy)
+{
+  int id = cpuid();
+
+  if((timers.slice[id] != 0) == busy)
+    return;
+  acquire(&timers.lock);
+  timers.slice[id] = busy ? nsecs() + TICKNS : 0;
+  arm();
+  release(&timers.lock);
+}
+
+// The local APIC timer went off: end the time slice if it is over,
+// run the functions of expired timers, and rearm.
+void
+timerintr(void)
+{
+  struct timer *t;
+  uint64_t now;
+  int id = cpuid();
+
+  if(id == 0 && clockticks())
+    clocktick();
+  now = nsecs();
+  acquire(&timers.lock);
+  if(timers.slice[id] != 0 && (clockticks() || now >= timers.slice[id])){
+    mycpu()->resched = 1;
+    timers.slice[id] = now + TICKNS;
+  }
+  while(timers.n > 0 && timers.heap[0]->when <= now){
+    t = timers.heap[0];
+    remove(t);
+    t->slot = TIMER_FIRING;
+    release(&timers.lock);
+    t->fn(t->arg);
+    acquire(&timers.lock);
+    if(t->slot == TIMER_FIRING)
+      t->slot = TIMER_IDLE;
+  }
+  arm();
+  release(&timers.lock);
+}
+
+static void
+napover(void *chan)
+{
+  acquire(&napslock);
+  wakeup(chan);
+  release(&napslock);
+}
+
+// Sleep for ns nanoseconds. Returns -1 if killed first.
+int
+nsleep(uint64_t ns)
+{
+  struct timer t = TIMER_INIT;
+  uint64_t end;
+  int r;
+
+  end = nsecs() + ns;
+  timeradd(&t, end, napover, &t);
+  r = 0;
+  acquire(&napslock);
+  while(nsecs() < end){
+    if(myproc()->killed){
+      r = -1;
+      break;
+    }
+    sleep(&t, &napslock);
+  }
+  release(&napslock);
+  timerdel(&t);
+  return r;
+}
@@ -0,0 +1,13 @@
+// A function to call once the nsecs() clock reaches a deadline.
+// See timer.c.
+struct timer {
+  uint64_t when;               // deadline, in nsecs()
+  void (*fn)(void*);           // called without locks held, from an interrupt
+  void *arg;
+  int slot;                    // index in the heap, or TIMER_IDLE/TIMER_FIRING
+};
+
+#define TIMER_IDLE    -1
+#define TIMER_FIRING  -2
+
+#define TIMER_INIT  { 0, 0, 0, TIMER_IDLE }
@@ -12,8 +12,6 @@
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
-struct spinlock tickslock;
-uint ticks;
 
 void
 tvinit(void)
@@ -23,8 +21,6 @@ tvinit(void)
   for(i = 0; i < 256; i++)
     SETGATE(idt[i], 0, SEG_KCODE<<3, vectors[i], 0);
   SETGATE(idt[T_SYSCALL], 1, SEG_KCODE<<3, vectors[T_SYSCALL], DPL_USER);
-
-  initlock(&tickslock, "time");
 }
 
 void
@@ -49,12 +45,7 @@ trap(struct trapframe *tf)
 
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
-    if(cpuid() == 0){
-      acquire(&tickslock);
-      ticks++;
-      wakeup(&ticks);
-      release(&tickslock);
-    }
+    timerintr();
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -73,9 +64,16 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_IRQ0 + IRQ_RESCHED:
+    // Another CPU queued work or an earlier timer for us;
+    // scheduler(), the preempted() check below or timerarm()
+    // takes it from here.
+    timerarm();
+    lapiceoi();
+    break;
+
   case T_IRQ0 + IRQ_ETH:
-    cprintf("NIC Interrupted!\n");
-    //e100_intr();
+    e1000_intr();
     lapiceoi();
     break;
   
@@ -86,6 +84,16 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_PGFLT:
+    // A page not loaded yet or a write to a copy-on-write page, from
+    // user space or from the kernel using user memory on a process's
+    // behalf. System calls fault their buffers in first (uvmtouch),
+    // so that running out of memory fails the call instead of
+    // ending up here.
+    if(myproc() && pagefault(myproc(), rcr2(), tf->err) == 0)
+      break;
+    // fall through
+
   //PAGEBREAK: 13
   default:
     if(myproc() == 0 || (tf->cs&3) == 0){
@@ -108,10 +116,13 @@ trap(struct trapframe *tf)
   if(myproc() && myproc()->killed && (tf->cs&3) == DPL_USER)
     exit();
 
-  // Force process to give up CPU on clock tick.
-  // If interrupts were on while locks held, would need to check nlock.
+  // Force process to give up CPU at the end of its time slice, or
+  // when a process that outranks it has been woken on this CPU. Only
+  // after an interrupt or a trap from user space: a fault in the
+  // kernel may come with a spinlock held, and interrupts are never
+  // on while one is.
   if(myproc() && myproc()->state == RUNNING &&
-     tf->trapno == T_IRQ0+IRQ_TIMER)
+     (tf->trapno >= T_IRQ0 || (tf->cs&3) == DPL_USER) && preempted())
     yield();
 
   // Check if the process has been killed since we yielded
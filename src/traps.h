@@ -35,5 +35,6 @@
 #define IRQ_ETH         11
 #define IRQ_IDE         14
 #define IRQ_ERROR       19
+#define IRQ_RESCHED     30      // IPI: look at the run queue
 #define IRQ_SPURIOUS    31
 
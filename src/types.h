@@ -7,6 +7,7 @@ typedef unsigned short ushort;
 typedef unsigned char  uchar;
 typedef uchar uint8_t;
 typedef uint pde_t;
+typedef uint pte_t;
 typedef ushort uint16_t;
 typedef unsigned long long uint64_t;
 
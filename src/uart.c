@@ -56,7 +56,7 @@ uartputc(int c)
   if(!uart)
     return;
   for(i = 0; i < 128 && !(inb(COM1+5) & 0x20); i++)
-    microdelay(10);
+    udelay(10);
   outb(COM1+0, c);
 }
 
@@ -0,0 +1,227 @@
+// Batched I/O through a ring shared with user space (see uring.h).
+//
+// One uring_enter() call takes a batch of submissions and completes
+// as many as are ready. An operation that would block (a read from
+// an empty pipe or socket, a write to a full pipe) stays pending in
+// the kernel and is retried on later calls, so one process can keep
+// requests outstanding on many files at once.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "poll.h"
+#include "uring.h"
+
+struct uringctx {
+  struct uring *ring;           // the shared page, kernel address
+  int npend;
+  struct {
+    struct uring_sqe sqe;
+    struct file *f;             // 0 for NOP or a bad fd
+  } pend[URING_ENTRIES];        // taken but not yet completed, in order
+};
+
+static struct slabcache *uringcache;
+
+void
+uringinit(void)
+{
+  uringcache = slabcreate("uring", sizeof(struct uringctx));
+}
+
+// Map a ring into the current process. Returns its user address.
+int
+uringsetup(void)
+{
+  struct proc *p = myproc();
+  struct uringctx *ctx;
+  char *ring;
+
+  if(p->uring)
+    return -1;
+  if((ctx = (struct uringctx*)slaballoc(uringcache)) == 0)
+    return -1;
+  if((ring = kzalloc()) == 0){
+    slabfree(uringcache, ctx);
+    return -1;
+  }
+  memset(ctx, 0, sizeof(*ctx));
+  if(mapuvm(p->pgdir, URINGVA, V2P(ring), PGSIZE, PTE_W) < 0){
+    kfree(ring);
+    slabfree(uringcache, ctx);
+    return -1;
+  }
+  ctx->ring = (struct uring*)ring;
+  p->uring = ctx;
+  return URINGVA;
+}
+
+// Tear down p's ring, if any: on exec and exit.
+void
+uringfree(struct proc *p)
+{
+  struct uringctx *ctx = p->uring;
+  int i;
+
+  if(ctx == 0)
+    return;
+  p->uring = 0;
+  for(i = 0; i < ctx->npend; i++)
+    if(ctx->pend[i].f)
+      fileclose(ctx->pend[i].f);
+  unmapuvm(p->pgdir, URINGVA, PGSIZE);
+  lcr3(V2P(p->pgdir));
+  kfree((char*)ctx->ring);
+  slabfree(uringcache, ctx);
+}
+
+// Would the operation complete without blocking?
+static int
+ready(struct uring_sqe *sqe, struct file *f)
+{
+  int r;
+
+  if(f == 0)
+    return 1;
+  if(sqe->op == URING_OP_READ){
+    if(!f->readable)
+      return 1;
+    r = filepoll(f, 0);
+    return (r & (POLLIN | POLLHUP | POLLERR)) != 0;
+  }
+  if(sqe->op == URING_OP_WRITE){
+    if(!f->writable)
+      return 1;
+    r = filepoll(f, 0);
+    return (r & (POLLOUT | POLLERR)) != 0;
+  }
+  return 1;
+}
+
+static int
+perform(struct uring_sqe *sqe, struct file *f)
+{
+  struct proc *p = myproc();
+
+  switch(sqe->op){
+  case URING_OP_NOP:
+    return 0;
+  case URING_OP_READ:
+  case URING_OP_WRITE:
+    if(f == 0 || sqe->len < 0 || sqe->addr >= USERTOP ||
+       !uvmaccess(p, sqe->addr, sqe->len, sqe->op == URING_OP_READ))
+      return -1;
+    if(uvmtouch(p, sqe->addr, sqe->len, sqe->op == URING_OP_READ) < 0)
+      return -1;
+    if(sqe->op == URING_OP_READ)
+      return fileread(f, (char*)sqe->addr, sqe->len);
+    return filewrite(f, (char*)sqe->addr, sqe->len);
+  }
+  return -1;
+}
+
+// Complete every pending operation that is ready, while there is
+// room in the completion queue. Returns the number completed.
+static int
+run(struct uringctx *ctx)
+{
+  struct uring *r = ctx->ring;
+  struct uring_cqe *cqe;
+  int i, j, n = 0;
+
+  for(i = 0; i < ctx->npend; ){
+    if(r->cq_tail - r->cq_head >= URING_ENTRIES)
+      break;
+    if(!ready(&ctx->pend[i].sqe, ctx->pend[i].f)){
+      i++;
+      continue;
+    }
+    cqe = &r->cq[r->cq_tail % URING_ENTRIES];
+    cqe->user_data = ctx->pend[i].sqe.user_data;
+    cqe->res = perform(&ctx->pend[i].sqe, ctx->pend[i].f);
+    r->cq_tail++;
+    n++;
+    if(ctx->pend[i].f)
+      fileclose(ctx->pend[i].f);
+    for(j = i + 1; j < ctx->npend; j++)
+      ctx->pend[j-1] = ctx->pend[j];
+    ctx->npend--;
+  }
+  return n;
+}
+
+// Sleep until a file with a pending operation may be ready.
+static void
+waitpending(struct uringctx *ctx)
+{
+  struct file *files[NOFILE];
+  struct pollfd fds[NOFILE];
+  int i, k, n = 0;
+  short ev;
+
+  for(i = 0; i < ctx->npend; i++){
+    ev = ctx->pend[i].sqe.op == URING_OP_READ ? POLLIN : POLLOUT;
+    for(k = 0; k < n; k++)
+      if(files[k] == ctx->pend[i].f)
+        break;
+    if(k == n){
+      if(n == NOFILE)
+        continue;
+      files[n] = ctx->pend[i].f;
+      fds[n].fd = n;
+      fds[n].events = 0;
+      n++;
+    }
+    fds[k].events |= ev;
+  }
+  poll(files, fds, n, -1);
+}
+
+// Take up to to_submit new entries from the submission queue, then
+// complete pending operations until at least min_complete completed
+// or nothing is pending. Returns the number of entries taken.
+int
+uringenter(int to_submit, int min_complete)
+{
+  struct proc *p = myproc();
+  struct uringctx *ctx = p->uring;
+  struct uring *r;
+  int fd, submitted = 0, completed = 0;
+
+  if(ctx == 0)
+    return -1;
+  r = ctx->ring;
+  while(submitted < to_submit && r->sq_head != r->sq_tail &&
+        ctx->npend < URING_ENTRIES){
+    // copy the entry once: user space may be scribbling on it
+    ctx->pend[ctx->npend].sqe = r->sq[r->sq_head % URING_ENTRIES];
+    ctx->pend[ctx->npend].f = 0;
+    fd = ctx->pend[ctx->npend].sqe.fd;
+    if(ctx->pend[ctx->npend].sqe.op != URING_OP_NOP &&
+       fd >= 0 && fd < NOFILE && p->ofile[fd])
+      ctx->pend[ctx->npend].f = filedup(p->ofile[fd]);
+    ctx->npend++;
+    r->sq_head++;
+    submitted++;
+  }
+
+  for(;;){
+    completed += run(ctx);
+    if(completed >= min_complete || ctx->npend == 0)
+      break;
+    if(r->cq_tail - r->cq_head >= URING_ENTRIES)
+      break;  // completion queue full: user space must harvest first
+    if(p->killed)
+      return -1;
+    waitpending(ctx);
+  }
+  return submitted;
+}
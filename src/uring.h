@@ -0,0 +1,38 @@
+#ifndef XV6_URING_H
+#define XV6_URING_H
+
+// Submission/completion ring shared between a process and the
+// kernel. User space fills sq[sq_tail] and advances sq_tail, then
+// calls uring_enter(); the kernel consumes entries at sq_head and
+// posts one completion per entry at cq_tail. User space reads
+// completions at cq_head and advances it.
+
+#define URING_ENTRIES   64
+
+#define URING_OP_NOP    0
+#define URING_OP_READ   1     // read(fd, addr, len)
+#define URING_OP_WRITE  2     // write(fd, addr, len)
+
+struct uring_sqe {
+  int op;
+  int fd;
+  uint addr;
+  int len;
+  uint user_data;       // copied to the completion
+};
+
+struct uring_cqe {
+  uint user_data;
+  int res;              // what read/write would have returned
+};
+
+struct uring {
+  volatile uint sq_head;      // written by the kernel
+  volatile uint sq_tail;      // written by user space
+  volatile uint cq_head;      // written by user space
+  volatile uint cq_tail;      // written by the kernel
+  struct uring_sqe sq[URING_ENTRIES];
+  struct uring_cqe cq[URING_ENTRIES];
+};
+
+#endif
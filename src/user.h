@@ -5,6 +5,12 @@
 
 struct stat;
 struct rtcdate;
+struct pollfd;
+struct uring;
+struct nm_if;
+struct kmemstat;
+struct lockstat;
+struct slabstat;
 
 // system calls
 int fork(void);
@@ -31,6 +37,25 @@ int uptime(void);
 int arp(char*, char*, char*, int);
 int checknic(int,int);
 int icmptest(int,int);
+int netsend(char*, void*, int);
+int netrecv(char*, void*, int);
+int nicctl(char*, int, int, uchar*);
+int nsecs(uint64_t*);
+int poll(struct pollfd*, int, int);
+int socket(char*, int);
+struct uring* uring_setup(void);
+int uring_enter(int, int);
+struct nm_if* netmap(char*, int);
+int nmsync(int);
+int kmemstat(struct kmemstat*);
+void* mmap(void*, uint, int, int, int, uint);
+int munmap(void*, uint);
+int yield(void);
+int setaffinity(uint);
+int setpriority(int, int, int);
+int usleep(int);
+int lockstat(struct lockstat*, int);
+int slabstat(struct slabstat*, int);
 
 // ulib.c
 int stat(char*, struct stat*);
@@ -7,6 +7,14 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "poll.h"
+#include "nic.h"
+#include "uring.h"
+#include "kmemstat.h"
+#include "mman.h"
+#include "sched.h"
+#include "lockstat.h"
+#include "slabstat.h"
 
 char buf[8192];
 char name[3];
@@ -1737,6 +1745,1112 @@ void argptest()
   printf(1, "arg test passed\n");
 }
 
+// microseconds since start on the nsecs() clock. User code has no
+// 64-bit division, so whole seconds are peeled off first.
+uint
+elapsedus(uint64_t start)
+{
+  uint64_t now, d;
+  uint s = 0;
+
+  nsecs(&now);
+  d = now - start;
+  while(d >= 1000000000ULL){
+    d -= 1000000000ULL;
+    s++;
+  }
+  return s*1000000 + (uint)d/1000;
+}
+
+// the nanosecond clock must be monotonic and agree with sleep().
+void
+clocktest(void)
+{
+  uint64_t t0, t1;
+  uint us;
+  int i;
+
+  printf(1, "clock test\n");
+  nsecs(&t0);
+  for(i = 0; i < 1000; i++){
+    nsecs(&t1);
+    if(t1 < t0){
+      printf(1, "clock: went backwards\n");
+      exit();
+    }
+    t0 = t1;
+  }
+  if(nsecs((uint64_t*)0xffffffff) != -1){
+    printf(1, "clock: bad pointer accepted\n");
+    exit();
+  }
+  nsecs(&t0);
+  sleep(2);
+  us = elapsedus(t0);
+  if(us < 1000 || us > 10000000){
+    printf(1, "clock: sleep(2) took %d us\n", us);
+    exit();
+  }
+  printf(1, "clock test ok\n");
+}
+
+// send frames through the software loopback interface and check
+// that they come back intact, in order, and that overflow drops.
+#define LOOP_FRAME   64
+#define LOOP_SLOTS   32    // LOOPBACK_SLOTS in loopback.h
+#define LOOP_MAX   1518    // NIC_FRAME_MAX in nic.h
+
+void
+looptest(void)
+{
+  static char out[LOOP_FRAME], in[LOOP_MAX];
+  int i, j, n;
+  uint64_t start;
+
+  printf(1, "loopback test\n");
+
+  if(netrecv("lo", in, sizeof(in)) != 0){
+    printf(1, "loopback: queue not empty at start\n");
+    exit();
+  }
+  if(netsend("nosuchif", out, sizeof(out)) >= 0){
+    printf(1, "loopback: send on missing interface succeeded\n");
+    exit();
+  }
+
+  // broadcast destination, zero source, local experimental ethertype
+  memset(out, 0xff, 6);
+  memset(out+6, 0, 6);
+  out[12] = 0x88;
+  out[13] = 0xb5;
+
+  for(i = 0; i < LOOP_SLOTS + 4; i++){
+    out[14] = i;
+    if(netsend("lo", out, sizeof(out)) != sizeof(out)){
+      printf(1, "loopback: send %d failed\n", i);
+      exit();
+    }
+  }
+  for(i = 0; i < LOOP_SLOTS; i++){
+    n = netrecv("lo", in, sizeof(in));
+    out[14] = i;
+    if(n != sizeof(out)){
+      printf(1, "loopback: frame %d bad length %d\n", i, n);
+      exit();
+    }
+    for(j = 0; j < n; j++){
+      if(in[j] != out[j]){
+        printf(1, "loopback: frame %d differs at byte %d\n", i, j);
+        exit();
+      }
+    }
+  }
+  if(netrecv("lo", in, sizeof(in)) != 0){
+    printf(1, "loopback: overflow frames were not dropped\n");
+    exit();
+  }
+
+  nsecs(&start);
+  for(i = 0; i < 20000; i++){
+    netsend("lo", out, sizeof(out));
+    if(netrecv("lo", in, sizeof(in)) != sizeof(out)){
+      printf(1, "loopback: lost frame %d\n", i);
+      exit();
+    }
+  }
+  printf(1, "loopback: 20000 round trips in %d us\n", elapsedus(start));
+
+  printf(1, "loopback test ok\n");
+}
+
+// VLAN configuration of the e1000, if there is one: tags and VLAN ids
+// are checked, and sent frames are only tagged in VLAN mode.
+void
+vlantest(void)
+{
+  printf(1, "vlan test\n");
+  if(nicctl("mynet0", NIC_CTL_VLAN, 0, 0) < 0){
+    printf(1, "vlan: no mynet0, skipped\n");
+    return;
+  }
+  if(nicctl("mynet0", NIC_CTL_VLAN_TAG, 5, 0) != -1){
+    printf(1, "vlan: tag accepted with VLAN mode off\n");
+    exit();
+  }
+  if(nicctl("mynet0", NIC_CTL_VLAN, 1, 0) < 0){
+    printf(1, "vlan: cannot turn VLAN mode on\n");
+    exit();
+  }
+  if(nicctl("mynet0", NIC_CTL_VLAN_ADD, 0, 0) != -1 ||
+     nicctl("mynet0", NIC_CTL_VLAN_ADD, 4095, 0) != -1 ||
+     nicctl("mynet0", NIC_CTL_VLAN_TAG, 0x10000, 0) != -1){
+    printf(1, "vlan: bad VLAN id or tag accepted\n");
+    exit();
+  }
+  if(nicctl("mynet0", NIC_CTL_VLAN_ADD, 5, 0) < 0 ||
+     nicctl("mynet0", NIC_CTL_VLAN_TAG, 5, 0) < 0 ||
+     nicctl("mynet0", NIC_CTL_VLAN_DEL, 5, 0) < 0){
+    printf(1, "vlan: VLAN id 5 refused\n");
+    exit();
+  }
+  if(nicctl("mynet0", NIC_CTL_VLAN, 0, 0) < 0 ||
+     nicctl("mynet0", NIC_CTL_VLAN_TAG, 5, 0) != -1 ||
+     nicctl("mynet0", NIC_CTL_VLAN_TAG, 0, 0) < 0){
+    printf(1, "vlan: tagging outlived VLAN mode\n");
+    exit();
+  }
+  printf(1, "vlan test ok\n");
+}
+
+// Receive filters of the e1000, if there is one: promiscuous mode,
+// receive address slots and multicast groups, and their bad arguments.
+void
+filtertest(void)
+{
+  static uchar mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+  static uchar group[6] = { 0x01, 0x00, 0x5e, 0x00, 0x00, 0xfb };
+  int i;
+
+  printf(1, "filter test\n");
+  if(nicctl("mynet0", NIC_CTL_PROMISC, 0, 0) < 0){
+    printf(1, "filter: no mynet0, skipped\n");
+    return;
+  }
+  if(nicctl("mynet0", NIC_CTL_PROMISC, 1, 0) < 0 ||
+     nicctl("mynet0", NIC_CTL_PROMISC, 0, 0) < 0){
+    printf(1, "filter: cannot switch promiscuous mode\n");
+    exit();
+  }
+
+  if(nicctl("mynet0", NIC_CTL_RAR_SET, -1, mac) != -1 ||
+     nicctl("mynet0", NIC_CTL_RAR_SET, 16, mac) != -1 ||
+     nicctl("mynet0", NIC_CTL_RAR_SET, 0, 0) != -1){
+    printf(1, "filter: bad receive address slot accepted\n");
+    exit();
+  }
+  for(i = 1; i < 16; i++)
+    if(nicctl("mynet0", NIC_CTL_RAR_SET, i, mac) < 0 ||
+       nicctl("mynet0", NIC_CTL_RAR_SET, i, 0) < 0){
+      printf(1, "filter: receive address slot %d refused\n", i);
+      exit();
+    }
+
+  if(nicctl("mynet0", NIC_CTL_MCAST_ADD, 0, 0) != -1 ||
+     nicctl("mynet0", NIC_CTL_MCAST_ADD, 0, mac) != -1 ||
+     nicctl("mynet0", NIC_CTL_MCAST_DEL, 0, group) != -1){
+    printf(1, "filter: bad multicast group accepted\n");
+    exit();
+  }
+  if(nicctl("mynet0", NIC_CTL_MCAST_ADD, 0, group) < 0 ||
+     nicctl("mynet0", NIC_CTL_MCAST_ADD, 0, group) < 0 ||
+     nicctl("mynet0", NIC_CTL_MCAST_DEL, 0, group) < 0 ||
+     nicctl("mynet0", NIC_CTL_MCAST_DEL, 0, group) != -1){
+    printf(1, "filter: joining and leaving a group failed\n");
+    exit();
+  }
+  printf(1, "filter test ok\n");
+}
+
+// poll() on pipes and loopback packet sockets.
+#define POLL_ETHERTYPE 0x88b5   // IEEE local experimental
+
+void
+polltest(void)
+{
+  struct pollfd pfd[3];
+  static char frame[LOOP_FRAME], in[LOOP_MAX];
+  int fds[2], s, n, pid;
+  uint us;
+  uint64_t start;
+
+  printf(1, "poll test\n");
+
+  if(pipe(fds) != 0){
+    printf(1, "poll: pipe() failed\n");
+    exit();
+  }
+  pfd[0].fd = fds[0];
+  pfd[0].events = POLLIN;
+  pfd[1].fd = fds[1];
+  pfd[1].events = POLLOUT;
+  pfd[2].fd = 99;
+  pfd[2].events = POLLIN;
+  if(poll(pfd, 3, 0) != 2 || pfd[0].revents != 0 ||
+     pfd[1].revents != POLLOUT || pfd[2].revents != POLLNVAL){
+    printf(1, "poll: wrong events on an empty pipe\n");
+    exit();
+  }
+
+  // timeout with nothing ready
+  nsecs(&start);
+  if(poll(pfd, 1, 50) != 0){
+    printf(1, "poll: empty pipe became readable\n");
+    exit();
+  }
+  us = elapsedus(start);
+  if(us < 50000){
+    printf(1, "poll: 50ms timeout returned after %d us\n", us);
+    exit();
+  }
+
+  // a writer in another process wakes a blocked poll
+  pid = fork();
+  if(pid == 0){
+    sleep(5);
+    write(fds[1], "x", 1);
+    exit();
+  }
+  if(poll(pfd, 1, -1) != 1 || pfd[0].revents != POLLIN){
+    printf(1, "poll: pipe write did not wake poll\n");
+    exit();
+  }
+  wait();
+  read(fds[0], in, 1);
+  close(fds[1]);
+  if(poll(pfd, 1, -1) != 1 || pfd[0].revents != POLLHUP){
+    printf(1, "poll: closed writer not reported\n");
+    exit();
+  }
+  close(fds[0]);
+
+  // packet sockets
+  if((s = socket("lo", POLL_ETHERTYPE)) < 0){
+    printf(1, "poll: socket() failed\n");
+    exit();
+  }
+  if(socket("lo", POLL_ETHERTYPE) >= 0){
+    printf(1, "poll: ethertype bound twice\n");
+    exit();
+  }
+  pfd[0].fd = s;
+  pfd[0].events = POLLIN;
+  if(poll(pfd, 1, 0) != 0){
+    printf(1, "poll: idle socket readable\n");
+    exit();
+  }
+  memset(frame, 0xff, 2*6);
+  frame[12] = POLL_ETHERTYPE >> 8;
+  frame[13] = POLL_ETHERTYPE & 0xff;
+  frame[14] = 'p';
+  pid = fork();
+  if(pid == 0){
+    sleep(5);
+    write(s, frame, sizeof(frame));
+    exit();
+  }
+  if(poll(pfd, 1, -1) != 1 || pfd[0].revents != POLLIN){
+    printf(1, "poll: frame did not wake poll\n");
+    exit();
+  }
+  wait();
+  if((n = read(s, in, sizeof(in))) != sizeof(frame) || in[14] != 'p'){
+    printf(1, "poll: socket read returned %d\n", n);
+    exit();
+  }
+  close(s);
+
+  printf(1, "poll test ok\n");
+}
+
+// batched reads and writes through the shared ring.
+void
+uringtest(void)
+{
+  struct uring *r;
+  struct uring_sqe *sqe;
+  static char out[8] = "uring", in[8];
+  int fds[2], pid, i;
+
+  printf(1, "uring test\n");
+  if(uring_enter(1, 1) != -1){
+    printf(1, "uring: enter without a ring succeeded\n");
+    exit();
+  }
+  r = uring_setup();
+  if((int)r == -1 || uring_setup() != (struct uring*)-1){
+    printf(1, "uring: setup failed or succeeded twice\n");
+    exit();
+  }
+  if(pipe(fds) != 0){
+    printf(1, "uring: pipe() failed\n");
+    exit();
+  }
+
+  // a read of an empty pipe stays pending; the write completes
+  // at once and the read with it
+  sqe = &r->sq[r->sq_tail++ % URING_ENTRIES];
+  sqe->op = URING_OP_READ;
+  sqe->fd = fds[0];
+  sqe->addr = (uint)in;
+  sqe->len = sizeof(in);
+  sqe->user_data = 1;
+  if(uring_enter(1, 0) != 1 || r->cq_tail != r->cq_head){
+    printf(1, "uring: read of an empty pipe completed\n");
+    exit();
+  }
+  sqe = &r->sq[r->sq_tail++ % URING_ENTRIES];
+  sqe->op = URING_OP_WRITE;
+  sqe->fd = fds[1];
+  sqe->addr = (uint)out;
+  sqe->len = sizeof(out);
+  sqe->user_data = 2;
+  sqe = &r->sq[r->sq_tail++ % URING_ENTRIES];
+  sqe->op = URING_OP_WRITE;
+  sqe->fd = 99;
+  sqe->user_data = 3;
+  if(uring_enter(2, 3) != 2 || r->cq_tail - r->cq_head != 3){
+    printf(1, "uring: batch did not complete\n");
+    exit();
+  }
+  for(i = 0; r->cq_head != r->cq_tail; r->cq_head++, i++){
+    struct uring_cqe *cqe = &r->cq[r->cq_head % URING_ENTRIES];
+    if((cqe->user_data == 3) != (cqe->res < 0) ||
+       (cqe->user_data != 3 && cqe->res != sizeof(out))){
+      printf(1, "uring: op %d returned %d\n", cqe->user_data, cqe->res);
+      exit();
+    }
+  }
+  if(strcmp(in, out) != 0){
+    printf(1, "uring: read back '%s'\n", in);
+    exit();
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  // the ring is not inherited
+  pid = fork();
+  if(pid == 0){
+    if(uring_enter(0, 0) != -1)
+      printf(1, "uring: child inherited the ring\n");
+    exit();
+  }
+  wait();
+  printf(1, "uring test ok\n");
+}
+
+// page allocator scaling: 1 to 8 processes each repeatedly grow and
+// shrink their heap, which allocates and frees pages on whatever CPU
+// they run on. Prints the time and how often the shared pool lock was
+// taken and contended; with per-CPU caches both should stay low as
+// processes (and CPUs) are added.
+#define KALLOC_PAGES  16
+#define KALLOC_ROUNDS 200
+
+void
+kalloctest(void)
+{
+  struct kmemstat st0, st1;
+  uint64_t start;
+  int np, i, j, k;
+  char *p;
+
+  printf(1, "kalloc test\n");
+  if(kmemstat((struct kmemstat*)0xffffffff) != -1){
+    printf(1, "kalloc: bad pointer accepted\n");
+    exit();
+  }
+  for(np = 1; np <= 8; np *= 2){
+    kmemstat(&st0);
+    nsecs(&start);
+    for(i = 0; i < np; i++){
+      if((k = fork()) < 0){
+        printf(1, "kalloc: fork failed\n");
+        exit();
+      }
+      if(k == 0){
+        for(j = 0; j < KALLOC_ROUNDS; j++){
+          if((p = sbrk(KALLOC_PAGES*4096)) == (char*)-1){
+            printf(1, "kalloc: sbrk failed\n");
+            exit();
+          }
+          for(k = 0; k < KALLOC_PAGES; k++)
+            p[k*4096] = j;
+          sbrk(-KALLOC_PAGES*4096);
+        }
+        exit();
+      }
+    }
+    for(i = 0; i < np; i++)
+      wait();
+    kmemstat(&st1);
+    // pre-zeroed pages handed out by kzalloc() skip kalloc()
+    k = (st1.allocs - st0.allocs) + (st1.zhits - st0.zhits);
+    if(k < np*KALLOC_ROUNDS*KALLOC_PAGES){
+      printf(1, "kalloc: only %d allocations counted\n", k);
+      exit();
+    }
+    printf(1, "kalloc: %d procs, %d pages: %d us, pool lock %d taken, %d contended, %d steals, %d/%d pre-zeroed\n",
+           np, np*KALLOC_ROUNDS*KALLOC_PAGES, elapsedus(start),
+           st1.acquired - st0.acquired, st1.contended - st0.contended,
+           st1.steals - st0.steals, st1.zhits - st0.zhits,
+           (st1.zhits - st0.zhits) + (st1.zmisses - st0.zmisses));
+  }
+  if(st1.nfree + KALLOC_PAGES < st0.nfree){
+    printf(1, "kalloc: %d pages lost\n", st0.nfree - st1.nfree);
+    exit();
+  }
+  // the buddy lists must account for every page in the pool
+  for(k = 0, i = 0; i < KMEM_ORDERS; i++)
+    k += st1.blocks[i] << i;
+  if(k != st1.pool){
+    printf(1, "kalloc: pool has %d pages, blocks hold %d\n", st1.pool, k);
+    exit();
+  }
+  printf(1, "kalloc test ok\n");
+}
+
+// copy-on-write fork: parent and child must see their own writes only,
+// including writes the kernel makes into a shared page (read() into a
+// buffer), and fork must not get slower with the size of the parent.
+#define COW_PAGES  256
+
+void
+cowtest(void)
+{
+  static char buf[4096];
+  struct kmemstat st0, st1;
+  char *mem, *argv[] = { "echo", 0 };
+  int fds[2], pid, i, n;
+  uint64_t start;
+  uint us, ex;
+
+  printf(1, "cow test\n");
+  mem = sbrk(COW_PAGES*4096);
+  if(mem == (char*)-1){
+    printf(1, "cow: sbrk failed\n");
+    exit();
+  }
+  for(i = 0; i < COW_PAGES; i++)
+    mem[i*4096] = i;
+  strcpy(buf, "parent");
+  if(pipe(fds) != 0){
+    printf(1, "cow: pipe failed\n");
+    exit();
+  }
+  if((pid = fork()) == 0){
+    for(i = 0; i < COW_PAGES; i++)
+      if(mem[i*4096] != (char)i){
+        printf(1, "cow: child sees wrong data\n");
+        exit();
+      }
+    for(i = 0; i < COW_PAGES; i++)
+      mem[i*4096] = ~i;
+    if(read(fds[0], buf, 6) != 6 || strcmp(buf, "kernel") != 0){
+      printf(1, "cow: child read wrong data\n");
+      exit();
+    }
+    exit();
+  }
+  write(fds[1], "kernel", 7);
+  wait();
+  close(fds[0]);
+  close(fds[1]);
+  for(i = 0; i < COW_PAGES; i++)
+    if(mem[i*4096] != (char)i){
+      printf(1, "cow: child's write seen by parent\n");
+      exit();
+    }
+  if(strcmp(buf, "parent") != 0){
+    printf(1, "cow: kernel write into child seen by parent\n");
+    exit();
+  }
+
+  // pages a fork costs before either side writes: the page directory,
+  // kernel stack and user page tables; the kernel's are shared
+  if(pipe(fds) != 0){
+    printf(1, "cow: pipe failed\n");
+    exit();
+  }
+  kmemstat(&st0);
+  if((pid = fork()) == 0){
+    read(fds[0], buf, 1);
+    exit();
+  }
+  kmemstat(&st1);
+  write(fds[1], "x", 1);
+  wait();
+  close(fds[0]);
+  close(fds[1]);
+  printf(1, "cow: fork of a %d KB parent took %d pages\n",
+         COW_PAGES*4, (int)(st0.nfree - st1.nfree));
+
+  // fork+exit and fork+exec latency with a 1MB parent
+  n = 50;
+  nsecs(&start);
+  for(i = 0; i < n; i++){
+    if((pid = fork()) == 0)
+      exit();
+    wait();
+  }
+  us = elapsedus(start);
+  nsecs(&start);
+  for(i = 0; i < n; i++){
+    if((pid = fork()) == 0){
+      close(1);   // keep echo quiet
+      exec("echo", argv);
+      exit();
+    }
+    wait();
+  }
+  ex = elapsedus(start);
+  printf(1, "cow: %d KB parent: fork+exit %d us, fork+exec %d us\n",
+         COW_PAGES*4, us / n, ex / n);
+
+  // with no memory left, a read() into a buffer still shared with
+  // the parent fails instead of faulting in the kernel
+  if((fds[0] = open("cowfile", O_CREATE|O_RDWR)) < 0){
+    printf(1, "cow: cannot create cowfile\n");
+    exit();
+  }
+  if((pid = fork()) == 0){
+    // read() at end of file faults in the buffer and returns 0
+    while((mem = sbrk(64*4096)) != (char*)-1 && read(fds[0], mem, 64*4096) == 0)
+      ;
+    while((mem = sbrk(4096)) != (char*)-1 && read(fds[0], mem, 4096) == 0)
+      ;
+    if(read(fds[0], buf, sizeof(buf)) != -1){
+      printf(1, "cow: read into shared buffer worked with no memory\n");
+      exit();
+    }
+    exit();
+  }
+  wait();
+  close(fds[0]);
+  unlink("cowfile");
+  sbrk(-COW_PAGES*4096);
+  printf(1, "cow test ok\n");
+}
+
+// sbrk() must not allocate memory until it is touched, and the kernel
+// must fault pages in for system calls as well as for user code.
+#define LAZY_BYTES  (8*1024*1024)
+
+void
+lazytest(void)
+{
+  struct kmemstat st0, st1;
+  char *a;
+  int fds[2], i;
+
+  printf(1, "lazy test\n");
+  kmemstat(&st0);
+  a = sbrk(LAZY_BYTES);
+  if(a == (char*)-1){
+    printf(1, "lazy: sbrk failed\n");
+    exit();
+  }
+  kmemstat(&st1);
+  if((int)(st0.nfree - st1.nfree) > 16){
+    printf(1, "lazy: sbrk took %d pages\n", st0.nfree - st1.nfree);
+    exit();
+  }
+  for(i = 0; i < LAZY_BYTES; i += LAZY_BYTES/8)
+    if(a[i] != 0){
+      printf(1, "lazy: new page not zero\n");
+      exit();
+    }
+  if(pipe(fds) != 0){
+    printf(1, "lazy: pipe failed\n");
+    exit();
+  }
+  write(fds[1], "lazy", 5);
+  if(read(fds[0], a + LAZY_BYTES - 4096, 5) != 5 || strcmp(a + LAZY_BYTES - 4096, "lazy") != 0){
+    printf(1, "lazy: read into untouched page failed\n");
+    exit();
+  }
+  close(fds[0]);
+  close(fds[1]);
+  kmemstat(&st1);
+  if((int)(st0.nfree - st1.nfree) > 32){
+    printf(1, "lazy: 9 touched pages took %d\n", st0.nfree - st1.nfree);
+    exit();
+  }
+  sbrk(-LAZY_BYTES);
+  printf(1, "lazy test ok\n");
+}
+
+// mmap: private and shared file mappings, anonymous memory, sharing
+// with a child, and system calls on mapped buffers.
+void
+mmaptest(void)
+{
+  static char data[6000];
+  char *p, *q;
+  int fd, i, pid;
+
+  printf(1, "mmap test\n");
+  for(i = 0; i < sizeof(data); i++)
+    data[i] = 'a' + i % 26;
+  unlink("mmapfile");
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, data, sizeof(data)) != sizeof(data)){
+    printf(1, "mmap: cannot create file\n");
+    exit();
+  }
+
+  // private: contents match, writes don't reach the file
+  p = mmap(0, sizeof(data), PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == MAP_FAILED){
+    printf(1, "mmap: private mapping failed\n");
+    exit();
+  }
+  for(i = 0; i < sizeof(data); i++)
+    if(p[i] != data[i]){
+      printf(1, "mmap: private mapping has wrong contents\n");
+      exit();
+    }
+  if(p[sizeof(data)] != 0){
+    printf(1, "mmap: no zeros past end of file\n");
+    exit();
+  }
+  p[0] = 'X';
+  if(munmap(p, sizeof(data)) < 0){
+    printf(1, "mmap: munmap failed\n");
+    exit();
+  }
+
+  // shared: writes reach the file on munmap; read-only mappings can
+  // be written out but not read into
+  p = mmap(0, sizeof(data), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  q = mmap(0, 4096, PROT_READ, MAP_SHARED, fd, 4096);
+  if(p == MAP_FAILED || q == MAP_FAILED){
+    printf(1, "mmap: shared mapping failed\n");
+    exit();
+  }
+  if(q[0] != data[4096] || read(fd, q, 1) != -1){
+    printf(1, "mmap: read-only mapping wrong\n");
+    exit();
+  }
+  p[1] = 'Y';
+  munmap(p, sizeof(data));
+  munmap(q, 4096);
+  close(fd);
+  fd = open("mmapfile", O_RDONLY);
+  if(read(fd, data, 2) != 2 || data[0] != 'a' || data[1] != 'Y'){
+    printf(1, "mmap: shared write not in file\n");
+    exit();
+  }
+  close(fd);
+  unlink("mmapfile");
+
+  // anonymous shared memory is shared with a child, including
+  // pages neither had touched before the fork
+  p = mmap(0, 8192, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANON, -1, 0);
+  if(p == MAP_FAILED){
+    printf(1, "mmap: anonymous mapping failed\n");
+    exit();
+  }
+  if((pid = fork()) == 0){
+    p[4096] = 2;
+    exit();
+  }
+  p[0] = 1;
+  wait();
+  if(p[0] != 1 || p[4096] != 2 || p[8191] != 0){
+    printf(1, "mmap: child's write not shared\n");
+    exit();
+  }
+  if(munmap(p + 4096, 4096) < 0 || munmap(p, 4096) < 0 || munmap(p, 4096) != -1){
+    printf(1, "mmap: partial munmap wrong\n");
+    exit();
+  }
+  printf(1, "mmap test ok\n");
+}
+
+// Processes pinned with setaffinity() must stay on their CPU, a
+// SCHED_RT process must run ahead of SCHED_FAIR ones, and many
+// processes yielding to each other measure the cost of a scheduling
+// decision.
+#define SCHED_PROCS   8
+#define SCHED_YIELDS  1000
+
+void
+schedtest(void)
+{
+  struct pollfd pfd;
+  uint64_t start;
+  int fds[2], i, pid;
+  uint us;
+
+  printf(1, "sched test\n");
+  if(setaffinity(0x80000000) != -1){
+    printf(1, "sched: affinity to a missing CPU accepted\n");
+    exit();
+  }
+  if((pid = fork()) == 0){
+    if(setaffinity(1) != 0){
+      printf(1, "sched: not moved to CPU 0\n");
+      exit();
+    }
+    for(i = 0; i < 100; i++){
+      yield();
+      if(setaffinity(1) != 0){
+        printf(1, "sched: pinned process left CPU 0\n");
+        exit();
+      }
+    }
+    exit();
+  }
+  wait();
+
+  if(setpriority(0, SCHED_FAIR, NICE_MAX + 1) != -1 ||
+     setpriority(0, SCHED_RT, NRTPRIO) != -1 ||
+     setpriority(0, 2, 0) != -1){
+    printf(1, "sched: bad priority accepted\n");
+    exit();
+  }
+  // On one CPU, a time-shared child must not run while a real-time
+  // parent is runnable, however often the parent yields.
+  if(pipe(fds) != 0){
+    printf(1, "sched: pipe failed\n");
+    exit();
+  }
+  setaffinity(1);
+  if(setpriority(0, SCHED_RT, 1) != 0){
+    printf(1, "sched: setpriority failed\n");
+    exit();
+  }
+  if((pid = fork()) == 0){
+    setpriority(0, SCHED_FAIR, 0);
+    write(fds[1], "x", 1);
+    exit();
+  }
+  yield();    // let the child drop to SCHED_FAIR
+  for(i = 0; i < 100; i++)
+    yield();
+  pfd.fd = fds[0];
+  pfd.events = POLLIN;
+  i = poll(&pfd, 1, 0);
+  setpriority(0, SCHED_FAIR, 0);
+  setaffinity(0);
+  wait();
+  close(fds[0]);
+  close(fds[1]);
+  if(i != 0){
+    printf(1, "sched: SCHED_FAIR child ran ahead of SCHED_RT parent\n");
+    exit();
+  }
+
+  nsecs(&start);
+  for(i = 0; i < SCHED_PROCS; i++){
+    if((pid = fork()) < 0){
+      printf(1, "sched: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      for(pid = 0; pid < SCHED_YIELDS; pid++)
+        yield();
+      exit();
+    }
+  }
+  for(i = 0; i < SCHED_PROCS; i++)
+    wait();
+  us = elapsedus(start);
+  printf(1, "sched: %d procs x %d yields in %d us\n",
+         SCHED_PROCS, SCHED_YIELDS, us);
+  printf(1, "sched test ok\n");
+}
+
+// Two processes bounce a byte through a pair of pipes, so that every
+// write wakes one sleeper. Timed alone and with many other processes
+// asleep, which wakeup() should not have to look at.
+#define PINGPONG_ROUNDS  5000
+#define PINGPONG_IDLE    24
+
+static uint
+pingpong(void)
+{
+  int ab[2], ba[2], i;
+  uint64_t start;
+  uint us;
+  char c;
+
+  if(pipe(ab) != 0 || pipe(ba) != 0){
+    printf(1, "pingpong: pipe failed\n");
+    exit();
+  }
+  if(fork() == 0){
+    for(i = 0; i < PINGPONG_ROUNDS; i++)
+      if(read(ab[0], &c, 1) != 1 || write(ba[1], &c, 1) != 1){
+        printf(1, "pingpong: child read/write failed\n");
+        exit();
+      }
+    exit();
+  }
+  nsecs(&start);
+  for(i = 0; i < PINGPONG_ROUNDS; i++){
+    c = i;
+    if(write(ab[1], &c, 1) != 1 || read(ba[0], &c, 1) != 1 || c != (char)i){
+      printf(1, "pingpong: bad round trip\n");
+      exit();
+    }
+  }
+  us = elapsedus(start);
+  wait();
+  close(ab[0]);
+  close(ab[1]);
+  close(ba[0]);
+  close(ba[1]);
+  return us;
+}
+
+void
+pingpongtest(void)
+{
+  int fds[2], i, n, pid;
+  uint alone, crowded;
+  char c;
+
+  printf(1, "pingpong test\n");
+  alone = pingpong();
+
+  if(pipe(fds) != 0){
+    printf(1, "pingpong: pipe failed\n");
+    exit();
+  }
+  for(n = 0; n < PINGPONG_IDLE; n++){
+    if((pid = fork()) < 0)
+      break;
+    if(pid == 0){
+      close(fds[1]);
+      read(fds[0], &c, 1);    // until the parent closes fds[1]
+      exit();
+    }
+  }
+  crowded = pingpong();
+  close(fds[1]);
+  for(i = 0; i < n; i++)
+    wait();
+  close(fds[0]);
+
+  printf(1, "pingpong: %d round trips in %d us, %d us with %d sleepers\n",
+         PINGPONG_ROUNDS, alone, crowded, n);
+  printf(1, "pingpong test ok\n");
+}
+
+// usleep() must not return early, and must not round up to clock
+// ticks either; sleep() still counts 10ms ticks.
+#define NAPS    20
+#define NAPUS   500
+
+void
+sleeptest(void)
+{
+  uint64_t start;
+  uint us;
+  int i;
+
+  printf(1, "sleep test\n");
+  if(usleep(-1) != -1){
+    printf(1, "sleep: negative usleep accepted\n");
+    exit();
+  }
+  nsecs(&start);
+  for(i = 0; i < NAPS; i++)
+    usleep(NAPUS);
+  us = elapsedus(start);
+  if(us < NAPS*NAPUS){
+    printf(1, "sleep: %d naps of %d us took only %d us\n", NAPS, NAPUS, us);
+    exit();
+  }
+  if(us >= NAPS*10000){
+    printf(1, "sleep: %d naps of %d us took %d us, one tick each\n",
+           NAPS, NAPUS, us);
+    exit();
+  }
+  printf(1, "sleep: usleep(%d) took %d us\n", NAPUS, us / NAPS);
+
+  nsecs(&start);
+  sleep(2);
+  us = elapsedus(start);
+  if(us < 20000){
+    printf(1, "sleep: sleep(2) took only %d us\n", us);
+    exit();
+  }
+  printf(1, "sleep test ok\n");
+}
+
+// lockstat() must report the kernel's locks, and the counts must grow
+// as they are used.
+static uint
+ptableacquires(void)
+{
+  static struct lockstat st[64];
+  int i, n;
+
+  n = lockstat(st, 64);
+  for(i = 0; i < n; i++)
+    if(strcmp(st[i].name, "ptable") == 0)
+      return st[i].acquires;
+  printf(1, "lockstat: no ptable lock among %d\n", n);
+  exit();
+}
+
+void
+lockstattest(void)
+{
+  uint n0, n1;
+  int i;
+
+  printf(1, "lockstat test\n");
+  if(lockstat(0, -1) != -1){
+    printf(1, "lockstat: negative count accepted\n");
+    exit();
+  }
+  n0 = ptableacquires();
+  for(i = 0; i < 10; i++){
+    if(fork() == 0)
+      exit();
+    wait();
+  }
+  n1 = ptableacquires();
+  if(n1 <= n0){
+    printf(1, "lockstat: ptable acquires went from %d to %d\n", n0, n1);
+    exit();
+  }
+  printf(1, "lockstat test ok\n");
+}
+
+// Pipes come from the "pipe" object cache: several share a page, and
+// once they are closed their pages go back to kalloc(), except those
+// pinned by objects waiting in CPU magazines.
+#define SLAB_PROCS  30
+#define SLAB_PIPES  5     // per process, with stdio, go[0] and ready[1]
+
+static void
+pipecache(struct slabstat *ps)
+{
+  static struct slabstat st[8];
+  int i, n;
+
+  n = slabstat(st, 8);
+  for(i = 0; i < n; i++)
+    if(strcmp(st[i].name, "pipe") == 0){
+      *ps = st[i];
+      return;
+    }
+  printf(1, "slab: no pipe cache among %d\n", n);
+  exit();
+}
+
+void
+slabtest(void)
+{
+  struct slabstat st0, st1, st2;
+  int go[2], ready[2], fds[2], i, j;
+  char c;
+
+  printf(1, "slab test\n");
+  if(pipe(go) < 0 || pipe(ready) < 0){
+    printf(1, "slab: pipe failed\n");
+    exit();
+  }
+  pipecache(&st0);
+  for(i = 0; i < SLAB_PROCS; i++){
+    if((j = fork()) < 0){
+      printf(1, "slab: fork failed\n");
+      exit();
+    }
+    if(j == 0){
+      close(go[1]);
+      close(ready[0]);
+      for(j = 0; j < SLAB_PIPES; j++)
+        if(pipe(fds) < 0){
+          printf(1, "slab: pipe %d failed\n", j);
+          exit();
+        }
+      write(ready[1], "x", 1);
+      read(go[0], &c, 1);  // until the parent closes go[1]
+      exit();
+    }
+  }
+  close(go[0]);
+  close(ready[1]);
+  for(i = 0; i < SLAB_PROCS; i++)
+    if(read(ready[0], &c, 1) != 1){
+      printf(1, "slab: child failed\n");
+      exit();
+    }
+  pipecache(&st1);
+  if(st1.inuse < st0.inuse + SLAB_PROCS*SLAB_PIPES){
+    printf(1, "slab: %d pipes in use, expected %d more than %d\n",
+           st1.inuse, SLAB_PROCS*SLAB_PIPES, st0.inuse);
+    exit();
+  }
+  printf(1, "slab: %d pipes in %d pages, %d objects per page\n",
+         st1.inuse, st1.slabs, st1.perslab);
+
+  close(go[1]);
+  for(i = 0; i < SLAB_PROCS; i++)
+    wait();
+  close(ready[0]);
+  pipecache(&st2);
+  // a slab beyond st0's holds magazine objects, or is the one kept
+  if(st2.inuse > st0.inuse || st2.slabs > st0.slabs + st2.cached + 1){
+    printf(1, "slab: %d pipes in %d pages after closing, %d cached\n",
+           st2.inuse, st2.slabs, st2.cached);
+    exit();
+  }
+  printf(1, "slab: %d slabs freed, %d refills, %d drains\n",
+         st2.shrinks - st0.shrinks, st2.refills - st0.refills,
+         st2.drains - st0.drains);
+  printf(1, "slab test ok\n");
+}
+
+// A real-time process woken on a CPU that is in the kernel with a lock
+// held, here copying pipe data into a page fork made copy-on-write,
+// must wait for the lock to be released rather than preempt.
+#define RTWAKE_ROUNDS 300
+
+void
+rtwaketest(void)
+{
+  static char buf[512];
+  int data[2], ping[2], i;
+  char c;
+
+  printf(1, "rtwake test\n");
+  if(pipe(data) != 0 || pipe(ping) != 0){
+    printf(1, "rtwake: pipe failed\n");
+    exit();
+  }
+  if(fork() == 0){
+    // sleeps in read() on CPU 0, woken from the writer's CPU
+    close(ping[1]);
+    setaffinity(1);
+    setpriority(0, SCHED_RT, 1);
+    while(read(ping[0], &c, 1) == 1)
+      ;
+    exit();
+  }
+  if(fork() == 0){
+    close(ping[0]);
+    setaffinity(2);   // fails if there is only CPU 0
+    for(i = 0; i < 10*RTWAKE_ROUNDS; i++)
+      write(ping[1], "x", 1);
+    exit();
+  }
+  close(ping[0]);
+  close(ping[1]);
+  setaffinity(1);
+  for(i = 0; i < RTWAKE_ROUNDS; i++){
+    if(fork() == 0)
+      exit();
+    if(write(data[1], buf, sizeof(buf)) != sizeof(buf) ||
+       read(data[0], buf, sizeof(buf)) != sizeof(buf)){
+      printf(1, "rtwake: pipe round trip %d failed\n", i);
+      exit();
+    }
+    wait();
+  }
+  setaffinity(0);
+  wait();
+  wait();
+  close(data[0]);
+  close(data[1]);
+  printf(1, "rtwake test ok\n");
+}
+
 unsigned long randstate = 1;
 unsigned int
 rand()
@@ -1796,6 +2910,22 @@ main(int argc, char *argv[])
   bigdir(); // slow
 
   uio();
+  clocktest();
+  looptest();
+  vlantest();
+  filtertest();
+  polltest();
+  uringtest();
+  kalloctest();
+  cowtest();
+  lazytest();
+  mmaptest();
+  schedtest();
+  pingpongtest();
+  sleeptest();
+  lockstattest();
+  slabtest();
+  rtwaketest();
 
   exectest();
 
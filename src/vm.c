@@ -6,6 +6,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "mman.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
@@ -32,20 +33,21 @@ seginit(void)
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page table pages.
-static pte_t *
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
   pde_t *pde;
   pte_t *pgtab;
 
   pde = &pgdir[PDX(va)];
+  if(*pde & PTE_PS)
+    return 0;    // a 4MB page: there is no page table
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
-      return 0;
     // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
+    if(!alloc || (pgtab = (pte_t*)kzalloc()) == 0)
+      return 0;
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table
     // entries, if necessary.
@@ -57,7 +59,7 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned.
-static int
+int
 mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 {
   char *a, *last;
@@ -96,6 +98,10 @@ mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 //                                  rw data + free physical memory
 //   0xfe000000..0: mapped direct (devices such as ioapic)
 //
+// Wherever a region covers a whole, aligned 4MB it is mapped with a
+// single 4MB page (PTE_PS), so all of physical memory above the first
+// 4MB and the device space need no page tables of their own.
+//
 // The kernel allocates physical memory for its heap and for user memory
 // between V2P(end) and the end of physical memory (PHYSTOP)
 // (directly addressable from end..P2V(PHYSTOP)).
@@ -114,36 +120,73 @@ static struct kmap {
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
-// Set up kernel part of a page table.
-pde_t*
-setupkvm(void)
+// Like mappages, for the kernel's part of a page table: 4MB-aligned
+// runs of 4MB are mapped by one PTE_PS directory entry each, with no
+// page table, which saves TLB entries and page table pages.
+static int
+kmappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 {
-  pde_t *pgdir;
-  struct kmap *k;
+  char *a, *last;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
-    return 0;
-  memset(pgdir, 0, PGSIZE);
-  if (P2V(PHYSTOP) > (void*)DEVSPACE)
-    panic("PHYSTOP too high");
-  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->virt, k->phys_end - k->phys_start,
-                (uint)k->phys_start, k->perm) < 0) {
-      freevm(pgdir);
-      return 0;
+  a = (char*)PGROUNDDOWN((uint)va);
+  last = (char*)PGROUNDDOWN(((uint)va) + size - 1);
+  for(;;){
+    if((uint)a % BIGPGSIZE == 0 && pa % BIGPGSIZE == 0 &&
+       (uint)(last - a) >= BIGPGSIZE - PGSIZE){
+      if(pgdir[PDX(a)] & PTE_P)
+        panic("remap");
+      pgdir[PDX(a)] = pa | perm | PTE_P | PTE_PS;
+      if((uint)(last - a) == BIGPGSIZE - PGSIZE)
+        break;
+      a += BIGPGSIZE;
+      pa += BIGPGSIZE;
+      continue;
     }
-  return pgdir;
+    if(mappages(pgdir, a, PGSIZE, pa, perm) < 0)
+      return -1;
+    if(a == last)
+      break;
+    a += PGSIZE;
+    pa += PGSIZE;
+  }
+  return 0;
 }
 
 // Allocate one page table for the machine for the kernel address
-// space for scheduler processes.
+// space for scheduler processes. Its kernel part, and the page tables
+// under it, never change afterwards and are shared by every process.
+// The kernel mappings are global (PTE_G), so they stay in the TLB
+// when a context switch loads CR3.
 void
 kvmalloc(void)
 {
-  kpgdir = setupkvm();
+  struct kmap *k;
+
+  if((kpgdir = (pde_t*)kzalloc()) == 0)
+    panic("kvmalloc");
+  if (P2V(PHYSTOP) > (void*)DEVSPACE)
+    panic("PHYSTOP too high");
+  for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
+    if(kmappages(kpgdir, k->virt, k->phys_end - k->phys_start,
+                 (uint)k->phys_start, k->perm | PTE_G) < 0)
+      panic("kvmalloc: out of memory");
   switchkvm();
 }
 
+// Set up kernel part of a page table by copying kpgdir's directory
+// entries, so no kernel page tables are allocated per process.
+pde_t*
+setupkvm(void)
+{
+  pde_t *pgdir;
+
+  if((pgdir = (pde_t*)kzalloc()) == 0)
+    return 0;
+  memmove(&pgdir[PDX(KERNBASE)], &kpgdir[PDX(KERNBASE)],
+          (NPDENTRIES - PDX(KERNBASE)) * sizeof(pde_t));
+  return pgdir;
+}
+
 // Switch h/w page table register to the kernel-only page table,
 // for when no process is running.
 void
@@ -186,8 +229,7 @@ inituvm(pde_t *pgdir, char *init, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kzalloc();
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
 }
@@ -224,20 +266,19 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   char *mem;
   uint a;
 
-  if(newsz >= KERNBASE)
+  if(newsz > USERTOP)
     return 0;
   if(newsz < oldsz)
     return oldsz;
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kzalloc();
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
       cprintf("allocuvm out of memory (2)\n");
       deallocuvm(pgdir, newsz, oldsz);
@@ -279,7 +320,7 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 }
 
 // Free a page table and all the physical memory pages
-// in the user part.
+// in the user part. The kernel part belongs to kpgdir.
 void
 freevm(pde_t *pgdir)
 {
@@ -288,8 +329,8 @@ freevm(pde_t *pgdir)
   if(pgdir == 0)
     panic("freevm: no pgdir");
   deallocuvm(pgdir, KERNBASE, 0);
-  for(i = 0; i < NPDENTRIES; i++){
-    if(pgdir[i] & PTE_P){
+  for(i = 0; i < PDX(KERNBASE); i++){
+    if((pgdir[i] & (PTE_P|PTE_PS)) == PTE_P){
       char * v = P2V(PTE_ADDR(pgdir[i]));
       kfree(v);
     }
@@ -297,6 +338,29 @@ freevm(pde_t *pgdir)
   kfree((char*)pgdir);
 }
 
+// Map the kernel-owned physical memory [pa, pa+size) at va, above
+// USERTOP, in the user part of pgdir. freevm would free it like any
+// user page, so the owner must unmapuvm it before the pgdir goes.
+int
+mapuvm(pde_t *pgdir, uint va, uint pa, uint size, int perm)
+{
+  if(va < USERTOP || va + size > KERNBASE || va + size < va)
+    return -1;
+  return mappages(pgdir, (char*)va, size, pa, perm | PTE_U);
+}
+
+// Remove mappings made by mapuvm, leaving the memory alone.
+void
+unmapuvm(pde_t *pgdir, uint va, uint size)
+{
+  pte_t *pte;
+  uint a;
+
+  for(a = PGROUNDDOWN(va); a < va + size; a += PGSIZE)
+    if((pte = walkpgdir(pgdir, (char*)a, 0)) != 0)
+      *pte = 0;
+}
+
 // Clear PTE_U on a page. Used to create an inaccessible
 // page beneath the user stack.
 void
@@ -316,29 +380,162 @@ pde_t*
 copyuvm(pde_t *pgdir, uint sz)
 {
   pde_t *d;
-  pte_t *pte;
-  uint pa, i, flags;
-  char *mem;
 
   if((d = setupkvm()) == 0)
     return 0;
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
-    if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
+  if(uvmshare(d, pgdir, 0, sz, 1) < 0){
+    lcr3(V2P(pgdir));
+    freevm(d);
+    return 0;
+  }
+  // pgdir is the current process's; its TLB may still allow writes.
+  lcr3(V2P(pgdir));
+  return d;
+}
+
+// Map the pages of [start, end) present in s into d too. If cow,
+// they become read-only in both until written (see cowfault);
+// otherwise both share them as they are. Caller flushes s's TLB.
+int
+uvmshare(pde_t *d, pde_t *s, uint start, uint end, int cow)
+{
+  pte_t *pte;
+  uint pa, i;
+
+  for(i = start; i < end; i += PGSIZE){
+    // Pages not touched yet stay that way in the child too;
+    // vmacopy() faults in shared mappings first.
+    if((pte = walkpgdir(s, (void *) i, 0)) == 0 || !(*pte & PTE_P))
+      continue;
+    if(cow && (*pte & PTE_W))
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE_ADDR(*pte);
-    flags = PTE_FLAGS(*pte);
+    if(mappages(d, (void*)i, PGSIZE, pa, PTE_FLAGS(*pte)) < 0)
+      return -1;
+    kref(P2V(pa));
+  }
+  return 0;
+}
+
+// Resolve a write fault at va on a copy-on-write page: copy the page,
+// or just make it writable again if no other process shares it.
+// Returns -1 if the fault was not for a copy-on-write page.
+int
+cowfault(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  uint pa;
+  char *mem;
+
+  if(va >= USERTOP || (pte = walkpgdir(pgdir, (void*)va, 0)) == 0)
+    return -1;
+  if((*pte & (PTE_P|PTE_U|PTE_COW)) != (PTE_P|PTE_U|PTE_COW))
+    return -1;
+  pa = PTE_ADDR(*pte);
+  if(krefcount(P2V(pa)) == 1){
+    *pte = (*pte & ~PTE_COW) | PTE_W;
+  } else {
     if((mem = kalloc()) == 0)
-      goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0)
-      goto bad;
+      return -1;
+    memmove(mem, P2V(pa), PGSIZE);
+    *pte = V2P(mem) | ((PTE_FLAGS(*pte) & ~PTE_COW) | PTE_W);
+    kfree(P2V(pa));
   }
-  return d;
+  invlpg((void*)va);
+  return 0;
+}
+
+// Fill in the missing page at va in p's address space, reading the
+// parts that lie in a program segment from the program file and
+// zeroing the rest. Returns -1 if va is outside the address space or
+// there is no memory. May sleep: no spinlocks may be held.
+int
+lazyfault(struct proc *p, uint va)
+{
+  struct seg *s;
+  pte_t *pte;
+  uint lo, hi;
+  char *mem;
 
-bad:
-  freevm(d);
+  va = PGROUNDDOWN(va);
+  if(va >= p->sz)
+    return -1;
+  if((pte = walkpgdir(p->pgdir, (void*)va, 0)) != 0 && (*pte & PTE_P))
+    return 0;
+  if((mem = kzalloc()) == 0)
+    return -1;
+  for(s = p->seg; s < &p->seg[p->nseg]; s++){
+    lo = va > s->va ? va : s->va;
+    hi = s->va + s->filesz;
+    if(hi > va + PGSIZE)
+      hi = va + PGSIZE;
+    if(lo >= hi)
+      continue;
+    ilock(p->exe);
+    if(readi(p->exe, mem + (lo - va), s->off + (lo - s->va), hi - lo) != hi - lo){
+      iunlock(p->exe);
+      kfree(mem);
+      return -1;
+    }
+    iunlock(p->exe);
+  }
+  if(mappages(p->pgdir, (char*)va, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Handle a page fault at va in p, with error code err.
+// Returns 0 if the faulting access can be retried.
+int
+pagefault(struct proc *p, uint va, uint err)
+{
+  struct vma *v;
+
+  if(va >= p->sz && (v = vmalookup(p, va)) != 0)
+    return vmafault(p, v, va, err);
+  if(!(err & FEC_PR))
+    return lazyfault(p, va);
+  if(err & FEC_WR)
+    return cowfault(p->pgdir, va);
+  return -1;
+}
+
+// Is [va, va+n) part of p's address space, and writable if write?
+int
+uvmaccess(struct proc *p, uint va, uint n, int write)
+{
+  struct vma *v;
+
+  if(va + n < va)
+    return 0;
+  if(va < p->sz)
+    return va + n <= p->sz;
+  if((v = vmalookup(p, va)) == 0 || va + n > v->va + v->len)
+    return 0;
+  return !write || (v->prot & PROT_WRITE);
+}
+
+// Fault in the pages of [va, va+n) that are not there yet and, if
+// write, copy the copy-on-write ones, so the kernel can use them
+// while holding locks. Returns -1 if it can't, out of memory say.
+int
+uvmtouch(struct proc *p, uint va, uint n, int write)
+{
+  pte_t *pte;
+  uint a;
+
+  if(n == 0)
+    return 0;
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    pte = walkpgdir(p->pgdir, (char*)a, 0);
+    if(pte && (*pte & PTE_P)){
+      if(write && (*pte & PTE_COW) && pagefault(p, a, FEC_PR|FEC_WR) < 0)
+        return -1;
+    } else if(pagefault(p, a, write ? FEC_WR : 0) < 0)
+      return -1;
+  }
   return 0;
 }
 
@@ -350,7 +547,7 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
@@ -140,6 +140,14 @@ sti(void)
   asm volatile("sti");
 }
 
+// Enable interrupts and wait for one. An interrupt cannot arrive
+// between the two, since sti takes effect after the next instruction.
+static inline void
+stihlt(void)
+{
+  asm volatile("sti; hlt");
+}
+
 static inline uint
 xchg(volatile uint *addr, uint newval)
 {
@@ -167,6 +175,39 @@ lcr3(uint val)
   asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+// Drop the TLB entry for the page containing addr.
+static inline void
+invlpg(void *addr)
+{
+  asm volatile("invlpg (%0)" : : "r" (addr) : "memory");
+}
+
+// Atomically add v to *addr and return the old value.
+static inline uint
+xadd(volatile uint *addr, uint v)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (v), "+m" (*addr) :
+               :
+               "cc");
+  return v;
+}
+
+// Tell the CPU it is in a spin-wait loop.
+static inline void
+pause(void)
+{
+  asm volatile("pause");
+}
+
+static inline uint64_t
+rdtsc(void)
+{
+  uint64_t val;
+  asm volatile("rdtsc" : "=A" (val));
+  return val;
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().